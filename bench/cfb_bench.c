@@ -0,0 +1,660 @@
+/**
+ * File              : cfb_bench.c
+ * Author            : Igor V. Sementsov <ig.kuzm@gmail.com>
+ * Date              : 14.10.2026
+ * Last Modified Date: 14.10.2026
+ * Last Modified By  : Igor V. Sementsov <ig.kuzm@gmail.com>
+ */
+
+/*
+ * Benchmark of cfb.h and property_set.h
+ * Generates compound file of chosen shape and times open
+ * (also with reuse of cfb and with sidecar index), listing
+ * of directory, lookup by name, extraction of streams and
+ * parsing of property set. Build (from repo root):
+ *
+ *   make -C bench
+ *
+ * cfb_bench_nofat is built with CFB_NO_FAT_CACHE (no test of
+ * index), add CFLAGS="-O2 -DCFB_STATS" to print counters of
+ * cfb after each test.
+ * Usage:
+ *
+ *   cfb_bench [-v 3|4] [-m mini] [-b big] [-s size] [-f]
+ *             [-t threads] [-T seconds] [-o file] [file]
+ *
+ *   -v  version of file: 3 (512 bytes sectors) or 4 (4096)
+ *   -m  number of mini streams (random size < 4096) [1000]
+ *   -b  number of big streams [4]
+ *   -s  size of big stream in bytes [1048576] - with more
+ *       then ~7MB of v3 file FAT needs DIFAT sectors
+ *   -f  fragment chains (sectors of streams are interleaved)
+ *   -t  threads of cfb_extract_all [4]
+ *   -T  minimal time of each test in seconds [0.5]
+ *   -o  keep generated file with this name
+ *
+ * If file is given it is benchmarked instead of generated one
+ * (lookup test uses names of its root storage).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cfb.h"
+#ifndef CFB_NO_FAT_CACHE
+#include "cfb_index.h"
+#endif
+#include "property_set.h"
+
+/*
+ * Generator
+ */
+
+struct gen_stream {
+	char name[32];
+	uint8_t * data;
+	ULONG size;
+	SECT start;
+};
+
+struct gen_chain {
+	uint8_t * data;    // content of chain
+	size_t size;
+	FSINDEX nsect;     // number of sectors
+	FSINDEX left;      // sectors not allocated yet
+	SECT first;
+	SECT last;
+};
+
+static uint32_t gen_seed = 12345;
+static uint32_t gen_rand(){
+	gen_seed = gen_seed * 1103515245u + 12345u;
+	return gen_seed >> 8;
+}
+
+// CFB order of names: shorter is less, then uppercased
+static int gen_namecmp(const char * a, const char * b){
+	size_t la = strlen(a), lb = strlen(b);
+	if (la != lb)
+		return la < lb ? -1 : 1;
+	for (; *a; ++a, ++b) {
+		int ca = (*a >= 'a' && *a <= 'z') ? *a - 0x20 : *a;
+		int cb = (*b >= 'a' && *b <= 'z') ? *b - 0x20 : *b;
+		if (ca != cb)
+			return ca - cb;
+	}
+	return 0;
+}
+
+static struct gen_stream * gen_sort_streams;
+static int gen_sort_compare(const void * a, const void * b){
+	return gen_namecmp(gen_sort_streams[*(const SID *)a].name,
+			gen_sort_streams[*(const SID *)b].name);
+}
+
+// balanced tree of sorted entries - all nodes are black
+static SID gen_tree(cfb_dir * dirs, const SID * sorted, int lo, int hi){
+	if (lo > hi)
+		return NOSTREAM;
+	int mid = (lo + hi) / 2;
+	SID sid = sorted[mid] + 1;
+	dirs[sid]._sidLeftSib = gen_tree(dirs, sorted, lo, mid - 1);
+	dirs[sid]._sidRightSib = gen_tree(dirs, sorted, mid + 1, hi);
+	return sid;
+}
+
+static void gen_dir(cfb_dir * dir, const char * name, BYTE mse,
+		SECT start, ULONG size)
+{
+	int i, len = strlen(name);
+	memset(dir, 0, sizeof(cfb_dir));
+	for (i = 0; i < len; ++i)
+		dir->_ab[2*i] = name[i];
+	dir->_cb = (len + 1) * 2;
+	dir->_mse = mse;
+	dir->_bflags = DE_BLACK;
+	dir->_sidLeftSib = dir->_sidRightSib = dir->_sidChild = NOSTREAM;
+	dir->_sectStart = start;
+	dir->_ulSize = size;
+}
+
+// property set with title, author, page count and thumbnail
+static uint8_t * gen_summary(ULONG * size){
+	static const uint8_t fmtid[16] = {
+		0xe0, 0x85, 0x9f, 0xf2, 0xf9, 0x4f, 0x68, 0x10,
+		0xab, 0x91, 0x08, 0x00, 0x2b, 0x27, 0xb3, 0xd9};
+	const char * title  = "Benchmark title";
+	const char * author = "Benchmark author";
+	uint8_t * buf = calloc(1, 8192), * p;
+	uint32_t * hdr = (uint32_t *)(buf + 48);
+	uint32_t off, dw;
+	int n = 0;
+
+	// header and one section
+	memcpy(buf, "\xFE\xFF\x00\x00\x05\x00\x02\x00", 8);
+	dw = 1;  memcpy(buf + 24, &dw, 4);
+	memcpy(buf + 28, fmtid, 16);
+	dw = 48; memcpy(buf + 44, &dw, 4);
+
+	// section header, table of 5 properties and values
+	p = buf + 48 + 8 + 5 * 8;
+#define GEN_PROP(pid) \
+	off = p - (buf + 48); hdr[2 + 2*n] = (pid); hdr[3 + 2*n] = off; n++
+	GEN_PROP(1);  dw = PSET_I2;  memcpy(p, &dw, 4); dw = 1252; memcpy(p + 4, &dw, 4); p += 8;
+	GEN_PROP(2);  dw = PSET_LPSTR; memcpy(p, &dw, 4); dw = strlen(title) + 1;
+	memcpy(p + 4, &dw, 4); memcpy(p + 8, title, dw); p += 8 + ((dw + 3) & ~3);
+	GEN_PROP(4);  dw = PSET_LPSTR; memcpy(p, &dw, 4); dw = strlen(author) + 1;
+	memcpy(p + 4, &dw, 4); memcpy(p + 8, author, dw); p += 8 + ((dw + 3) & ~3);
+	GEN_PROP(14); dw = PSET_I4;  memcpy(p, &dw, 4); dw = 42; memcpy(p + 4, &dw, 4); p += 8;
+	GEN_PROP(17); dw = PSET_CF;  memcpy(p, &dw, 4); dw = 4000;
+	memcpy(p + 4, &dw, 4); memset(p + 8, 'x', dw); p += 8 + dw;
+#undef GEN_PROP
+	hdr[0] = p - (buf + 48);
+	hdr[1] = n;
+
+	*size = p - buf;
+	return buf;
+}
+
+/*
+ * Make compound file of version with nmini mini streams and
+ * nbig streams of bigsize bytes, return file data and its
+ * size or NULL
+ */
+static uint8_t * gen_cfb(int version, int nmini, int nbig, ULONG bigsize,
+		bool fragment, size_t * fsize)
+{
+	DWORD ssize = version == 4 ? 4096 : 512;
+	DWORD msize = 64, cutoff = 4096;
+	FSINDEX per = ssize / 4;
+	int i, c, nstreams = nmini + nbig + 1;
+
+	struct gen_stream * streams = calloc(nstreams, sizeof(struct gen_stream));
+	if (!streams)
+		return NULL;
+
+	// streams: summary, mini and big
+	streams[0].data = gen_summary(&streams[0].size);
+	strcpy(streams[0].name, "\005SummaryInformation");
+	for (i = 1; i < nstreams; ++i) {
+		struct gen_stream * s = &streams[i];
+		ULONG k;
+		if (i <= nmini) {
+			snprintf(s->name, sizeof(s->name), "Mini%05d", i);
+			s->size = 1 + gen_rand() % (cutoff - 1);
+		} else {
+			snprintf(s->name, sizeof(s->name), "Big%03d", i - nmini);
+			s->size = bigsize;
+		}
+		s->data = malloc(s->size);
+		if (!s->data)
+			return NULL;
+		for (k = 0; k < s->size; ++k)
+			s->data[k] = (uint8_t)(k * 31 + i);
+	}
+
+	// ministream and miniFAT
+	size_t mlen = 0;
+	FSINDEX nminisect = 0;
+	for (i = 0; i < nstreams; ++i)
+		if (streams[i].size < cutoff)
+			nminisect += (streams[i].size + msize - 1) / msize;
+	uint8_t * ministream = calloc(nminisect ? nminisect : 1, msize);
+	SECT * minifat = malloc(((size_t)nminisect + per) * 4);
+	if (!ministream || !minifat)
+		return NULL;
+	FSINDEX m = 0;
+	for (i = 0; i < nstreams; ++i) {
+		struct gen_stream * s = &streams[i];
+		if (s->size >= cutoff)
+			continue;
+		FSINDEX k, n = (s->size + msize - 1) / msize;
+		s->start = m;
+		memcpy(ministream + (size_t)m * msize, s->data, s->size);
+		for (k = 0; k < n; ++k, ++m)
+			minifat[m] = k + 1 < n ? m + 1 : ENDOFCHAIN;
+	}
+	mlen = (size_t)m * msize;
+	FSINDEX nmfsect = (m * 4 + ssize - 1) / ssize;
+	for (; m < nmfsect * per; ++m)
+		minifat[m] = FREESECT;
+
+	// directory
+	SID ndirs = nstreams + 1;
+	SID dirsper = ssize / sizeof(cfb_dir);
+	FSINDEX ndirsect = (ndirs + dirsper - 1) / dirsper;
+	cfb_dir * dirs = calloc((size_t)ndirsect * dirsper, sizeof(cfb_dir));
+	if (!dirs)
+		return NULL;
+
+	// chains: 0 - directory, 1 - miniFAT, 2 - ministream,
+	// 3... - big streams
+	int nchains = 3 + nstreams;
+	struct gen_chain * chains = calloc(nchains, sizeof(struct gen_chain));
+	if (!chains)
+		return NULL;
+	chains[0].data = (uint8_t *)dirs;
+	chains[0].size = (size_t)ndirsect * ssize;
+	chains[1].data = (uint8_t *)minifat;
+	chains[1].size = (size_t)nmfsect * ssize;
+	chains[2].data = ministream;
+	chains[2].size = mlen;
+	for (i = 0; i < nstreams; ++i)
+		if (streams[i].size >= cutoff) {
+			chains[3 + i].data = streams[i].data;
+			chains[3 + i].size = streams[i].size;
+		}
+	FSINDEX ndata = 0;
+	for (c = 0; c < nchains; ++c) {
+		chains[c].nsect = chains[c].left = (chains[c].size + ssize - 1) / ssize;
+		chains[c].first = chains[c].last = ENDOFCHAIN;
+		ndata += chains[c].nsect;
+	}
+
+	// FAT sectors cover all sectors including FAT and DIFAT
+	FSINDEX nfat = 0, ndif = 0;
+	for (;;) {
+		FSINDEX total = ndata + nfat + ndif;
+		FSINDEX needfat = (total + per - 1) / per;
+		FSINDEX needdif = needfat <= 109 ? 0 :
+			(needfat - 109 + per - 2) / (per - 1);
+		if (needfat == nfat && needdif == ndif)
+			break;
+		nfat = needfat; ndif = needdif;
+	}
+	FSINDEX total = ndata + nfat + ndif;
+	*fsize = (size_t)(total + 1) * ssize;
+	uint8_t * file = calloc(1, *fsize);
+	SECT * fat = malloc((size_t)nfat * ssize);
+	if (!file || !fat)
+		return NULL;
+	for (m = 0; m < nfat * per; ++m)
+		fat[m] = FREESECT;
+
+	// allocate sectors - chains one by one or interleaved by
+	// runs of 1-3 sectors, data sectors go first
+	SECT sect = 0;
+	c = 0;
+	while (sect < ndata) {
+		if (fragment)
+			c = gen_rand() % nchains;
+		while (chains[c].left == 0)
+			c = (c + 1) % nchains;
+		FSINDEX run = fragment ? 1 + gen_rand() % 3 : chains[c].left;
+		for (; run && chains[c].left; --run, --chains[c].left, ++sect) {
+			if (chains[c].last == ENDOFCHAIN)
+				chains[c].first = sect;
+			else
+				fat[chains[c].last] = sect;
+			chains[c].last = sect;
+			fat[sect] = ENDOFCHAIN;
+		}
+	}
+	for (m = 0; m < nfat; ++m)
+		fat[ndata + m] = FATSECT;
+	for (m = 0; m < ndif; ++m)
+		fat[ndata + nfat + m] = DIFSECT;
+	for (i = 0; i < nstreams; ++i)
+		if (streams[i].size >= cutoff)
+			streams[i].start = chains[3 + i].first;
+
+	// directory tree of root storage
+	SID * sorted = malloc(nstreams * sizeof(SID));
+	if (!sorted)
+		return NULL;
+	for (i = 0; i < nstreams; ++i)
+		sorted[i] = i;
+	gen_sort_streams = streams;
+	qsort(sorted, nstreams, sizeof(SID), gen_sort_compare);
+	gen_dir(&dirs[0], "Root Entry", STGTY_ROOT,
+			mlen ? chains[2].first : ENDOFCHAIN, mlen);
+	for (i = 0; i < nstreams; ++i)
+		gen_dir(&dirs[i + 1], streams[i].name, STGTY_STREAM,
+				streams[i].size ? streams[i].start : ENDOFCHAIN,
+				streams[i].size);
+	dirs[0]._sidChild = gen_tree(dirs, sorted, 0, nstreams - 1);
+	for (i = ndirs; i < (int)(ndirsect * dirsper); ++i)
+		dirs[i]._sidLeftSib = dirs[i]._sidRightSib = dirs[i]._sidChild = NOSTREAM;
+
+	// write chains
+	for (c = 0; c < nchains; ++c) {
+		size_t off = 0;
+		for (sect = chains[c].first; off < chains[c].size; sect = fat[sect]) {
+			size_t len = chains[c].size - off < ssize ? chains[c].size - off : ssize;
+			memcpy(file + ((size_t)sect + 1) * ssize, chains[c].data + off, len);
+			off += len;
+		}
+	}
+
+	// FAT and DIFAT sectors
+	for (m = 0; m < nfat; ++m)
+		memcpy(file + ((size_t)ndata + m + 1) * ssize, fat + (size_t)m * per, ssize);
+	for (m = 0; m < ndif; ++m) {
+		SECT * dif = (SECT *)(file + ((size_t)ndata + nfat + m + 1) * ssize);
+		FSINDEX k;
+		for (k = 0; k < per - 1; ++k) {
+			FSINDEX j = 109 + m * (per - 1) + k;
+			dif[k] = j < nfat ? ndata + j : FREESECT;
+		}
+		dif[per - 1] = m + 1 < ndif ? ndata + nfat + m + 1 : ENDOFCHAIN;
+	}
+
+	// header
+	cfb_header * h = (cfb_header *)file;
+	memcpy(h->_abSig, cfb_signature, 8);
+	h->_uMinorVersion = 0x3E;
+	h->_uDllVersion = version;
+	h->_uByteOrder = 0xFFFE;
+	h->_uSectorShift = version == 4 ? 12 : 9;
+	h->_uMiniSectorShift = 6;
+	h->_ulReserved2 = version == 4 ? ndirsect : 0; // number of directory sectors
+	h->_csectFat = nfat;
+	h->_sectDirStart = chains[0].first;
+	h->_ulMiniSectorCutoff = cutoff;
+	h->_sectMiniFatStart = nmfsect ? chains[1].first : ENDOFCHAIN;
+	h->_csectMiniFat = nmfsect;
+	h->_sectDifStart = ndif ? ndata + nfat : ENDOFCHAIN;
+	h->_csectDif = ndif;
+	for (m = 0; m < 109; ++m)
+		h->_sectFat[m] = m < nfat ? ndata + m : FREESECT;
+
+	for (i = 0; i < nstreams; ++i)
+		free(streams[i].data);
+	free(streams); free(ministream); free(minifat); free(dirs);
+	free(chains); free(fat); free(sorted);
+	return file;
+}
+
+/*
+ * Timing
+ */
+
+static double bench_time = 0.5;
+
+static uint64_t bench_now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// run test until bench_time passed, print ns/op and MB/s
+static void bench_run(const char * name, void * ctx,
+		size_t (*test)(void * ctx))
+{
+	uint64_t ops = 0, bytes = 0, start = bench_now(), ns;
+	do {
+		bytes += test(ctx);
+		ops++;
+		ns = bench_now() - start;
+	} while (ns < bench_time * 1e9);
+	printf("%-12s %10llu ops %14.1f ns/op", name,
+			(unsigned long long)ops, (double)ns / ops);
+	if (bytes)
+		printf(" %12llu bytes/op %10.1f MB/s",
+				(unsigned long long)(bytes / ops), bytes / (ns / 1e9) / 1e6);
+	printf("\n");
+}
+
+#ifdef CFB_STATS
+static void bench_stats(struct cfb * cfb){
+	struct cfb_stats s;
+	cfb_get_stats(cfb, &s);
+	printf("%12s reads %llu seeks %llu bytes %llu fat %llu mfat %llu "
+			"difat %llu dirs %llu\n", "",
+			(unsigned long long)s.reads, (unsigned long long)s.seeks,
+			(unsigned long long)s.bytes, (unsigned long long)s.fat_lookups,
+			(unsigned long long)s.mfat_lookups, (unsigned long long)s.difat_hops,
+			(unsigned long long)s.dir_reads);
+}
+#else
+#define bench_stats(cfb)
+#endif
+
+/*
+ * Tests
+ */
+
+struct bench {
+	const char * path;
+	struct cfb cfb;
+	struct cfb rcfb;     // reopened for each file in test_reopen
+	char index[BUFSIZ];  // sidecar index of file for test_index
+	char (*names)[100];  // names of streams of root storage
+	int nnames;
+	uint8_t * buf;       // buffer of size of biggest stream
+	size_t bufsize;
+	FILE * summary;      // copy of summary information stream
+	int nthreads;
+	volatile size_t sink; // results of tests are kept here
+	bool generated;       // file is made by generator
+};
+
+static size_t test_open(void * ctx){
+	struct bench * b = ctx;
+	struct cfb cfb;
+	if (cfb_open(&cfb, b->path)){
+		fprintf(stderr, "can't open %s\n", b->path);
+		exit(EXIT_FAILURE);
+	}
+	cfb_close(&cfb);
+	return 0;
+}
+
+static size_t test_reopen(void * ctx){
+	struct bench * b = ctx;
+	if (cfb_reopen(&b->rcfb, b->path)){
+		fprintf(stderr, "can't open %s\n", b->path);
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
+
+#ifndef CFB_NO_FAT_CACHE
+static size_t test_index(void * ctx){
+	struct bench * b = ctx;
+	struct cfb cfb;
+	if (cfb_open_index(&cfb, b->path, b->index)){
+		fprintf(stderr, "can't open %s with index\n", b->path);
+		exit(EXIT_FAILURE);
+	}
+	cfb_close(&cfb);
+	return 0;
+}
+#endif
+
+static int test_dirs_callback(void * user_data, cfb_dir dir){
+	(*(size_t *)user_data)++;
+	return 0;
+}
+
+static size_t test_dirs(void * ctx){
+	struct bench * b = ctx;
+	size_t n = 0;
+	cfb_get_dirs(&b->cfb, &n, test_dirs_callback);
+	b->sink += n;
+	return 0;
+}
+
+static size_t test_lookup(void * ctx){
+	struct bench * b = ctx;
+	cfb_dir dir;
+	const char * name = b->names[gen_rand() % b->nnames];
+	if (cfb_get_dir_by_name(&b->cfb, &dir, name)){
+		fprintf(stderr, "can't find %s\n", name);
+		exit(EXIT_FAILURE);
+	}
+	return 0;
+}
+
+// read all streams with stream reader
+static size_t test_read(void * ctx){
+	struct bench * b = ctx;
+	size_t bytes = 0;
+	SID sid;
+	for (sid = 1; sid < b->cfb.dirn; ++sid) {
+		cfb_dir * dir = &b->cfb.dirs[sid];
+		cfb_stream stream;
+		if (dir->_mse != STGTY_STREAM)
+			continue;
+		if (cfb_stream_open(&b->cfb, dir, &stream))
+			continue;
+		ssize_t len = cfb_stream_read(&stream, 0, b->buf, dir->_ulSize);
+		if (len > 0)
+			bytes += len;
+		cfb_stream_close(&stream);
+	}
+	return bytes;
+}
+
+static int test_extract_callback(void * user_data, SID sid, const cfb_dir * dir,
+			ULONG offset, const uint8_t * data, size_t len)
+{
+	__atomic_fetch_add((size_t *)user_data, len, __ATOMIC_RELAXED);
+	return 0;
+}
+
+static size_t test_extract(void * ctx){
+	struct bench * b = ctx;
+	size_t bytes = 0;
+	cfb_extract_all(&b->cfb, b->nthreads, &bytes, test_extract_callback);
+	return bytes;
+}
+
+static int test_property_callback(void * user_data, uint32_t propid,
+		uint32_t dwType, uint8_t * value)
+{
+	(*(int *)user_data)++;
+	return 0;
+}
+
+static size_t test_property(void * ctx){
+	struct bench * b = ctx;
+	int n = 0;
+	rewind(b->summary);
+	if (property_set_get(b->summary, &n, test_property_callback) || 
+			(n != 5 && b->generated))
+	{
+		fprintf(stderr, "can't parse property set\n");
+		exit(EXIT_FAILURE);
+	}
+	b->sink += n;
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int version = 3, nmini = 1000, nbig = 4, opt;
+	ULONG bigsize = 1024 * 1024;
+	bool fragment = false;
+	const char * out = NULL;
+	char tmp[] = "/tmp/cfb_benchXXXXXX";
+	struct bench b;
+	memset(&b, 0, sizeof(b));
+	b.nthreads = 4;
+
+	while ((opt = getopt(argc, argv, "v:m:b:s:ft:T:o:h")) != -1) {
+		switch (opt) {
+			case 'v': version = atoi(optarg); break;
+			case 'm': nmini = atoi(optarg); break;
+			case 'b': nbig = atoi(optarg); break;
+			case 's': bigsize = strtoul(optarg, NULL, 0); break;
+			case 'f': fragment = true; break;
+			case 't': b.nthreads = atoi(optarg); break;
+			case 'T': bench_time = atof(optarg); break;
+			case 'o': out = optarg; break;
+			default:
+				fprintf(stderr, "usage: %s [-v 3|4] [-m mini] [-b big] "
+						"[-s size] [-f] [-t threads] [-T seconds] [-o file] "
+						"[file]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+	if (version != 3 && version != 4)
+		version = 3;
+	if (bigsize < 4096)
+		bigsize = 4096;
+
+	if (optind < argc)
+		b.path = argv[optind];
+	else {
+		size_t size;
+		uint8_t * data = gen_cfb(version, nmini, nbig, bigsize, fragment, &size);
+		if (!data){
+			fprintf(stderr, "can't generate file\n");
+			return EXIT_FAILURE;
+		}
+		FILE * fp;
+		if (out)
+			fp = fopen(out, "wb");
+		else {
+			int fd = mkstemp(tmp);
+			fp = fd < 0 ? NULL : fdopen(fd, "wb");
+		}
+		if (!fp || fwrite(data, 1, size, fp) != size){
+			fprintf(stderr, "can't write file\n");
+			return EXIT_FAILURE;
+		}
+		fclose(fp);
+		free(data);
+		b.path = out ? out : tmp;
+		b.generated = true;
+		printf("file: v%d, %d mini streams, %d streams of %lu bytes%s, "
+				"%zu bytes\n", version, nmini, nbig, (unsigned long)bigsize,
+				fragment ? ", fragmented" : "", size);
+	}
+
+	if (cfb_open(&b.cfb, b.path)){
+		fprintf(stderr, "can't open %s\n", b.path);
+		return EXIT_FAILURE;
+	}
+
+	// names of streams in root storage and biggest stream
+	SID sid;
+	b.names = malloc(b.cfb.dirn * sizeof(*b.names));
+	for (sid = 1; sid < b.cfb.dirn; ++sid) {
+		cfb_dir * dir = &b.cfb.dirs[sid];
+		if (dir->_mse == STGTY_INVALID)
+			continue;
+		if (dir->_ulSize > b.bufsize)
+			b.bufsize = dir->_ulSize;
+		WORD name[32];
+		int len = _cfb_dir_name16(dir, name);
+		if (_cfb_dir_lookup(&b.cfb, 0, name, len) == sid)
+			cfb_dir_name(dir, b.names[b.nnames++]);
+	}
+	b.buf = malloc(b.bufsize ? b.bufsize : 1);
+	b.summary = cfb_get_stream(&b.cfb, "\005SummaryInformation");
+
+	bench_run("open", &b, test_open);
+	if (cfb_open(&b.rcfb, b.path) == 0){
+		bench_run("reopen", &b, test_reopen);
+		cfb_close(&b.rcfb);
+	}
+#ifndef CFB_NO_FAT_CACHE
+	snprintf(b.index, sizeof(b.index), "%s.idx", b.path);
+	if (cfb_index_save(&b.cfb, b.path, b.index) == 0){
+		bench_run("open_index", &b, test_index);
+		unlink(b.index);
+	}
+#endif
+	bench_run("get_dirs", &b, test_dirs);
+	if (b.nnames)
+		bench_run("lookup", &b, test_lookup);
+	bench_run("read", &b, test_read);
+	bench_stats(&b.cfb);
+	bench_run("extract", &b, test_extract);
+	if (b.summary)
+		bench_run("property", &b, test_property);
+
+	if (b.summary)
+		fclose(b.summary);
+	free(b.names);
+	free(b.buf);
+	cfb_close(&b.cfb);
+	if (!out && optind >= argc)
+		unlink(tmp);
+	return 0;
+}
@@ -20,9 +20,23 @@ extern "C"{
 #endif
 
 #include <stdint.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <byteswap.h>
 
+#ifndef CFB_NO_SIMD
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <immintrin.h>
+#define _BYTEORDER_SHUFFLE
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define _BYTEORDER_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define _BYTEORDER_NEON
+#endif
+#endif
+
 static bool is_little_endian()
 {
 	int x = 1;
@@ -73,6 +87,91 @@ static uint64_t ctohll (uint64_t x)
 	return x;
 }
 
+/*
+ * Arrays are swapped in place (pointer may be not aligned)
+ * with byte shuffle - pshufb on SSSE3/AVX2, shifts on SSE2,
+ * vrev on NEON and bswap for the tail
+ */
+static void bswap_32_array(uint32_t * a, size_t n)
+{
+	size_t i = 0;
+#if defined(_BYTEORDER_SHUFFLE)
+#ifdef __AVX2__
+	const __m256i m256 = _mm256_setr_epi8(
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; i + 8 <= n; i += 8) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(a + i));
+		_mm256_storeu_si256((__m256i *)(a + i), _mm256_shuffle_epi8(v, m256));
+	}
+#endif
+	const __m128i m = _mm_setr_epi8(
+			3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((__m128i *)(a + i));
+		_mm_storeu_si128((__m128i *)(a + i), _mm_shuffle_epi8(v, m));
+	}
+#elif defined(_BYTEORDER_SSE2)
+	for (; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((__m128i *)(a + i));
+		// swap words, then bytes in words
+		v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *)(a + i), v);
+	}
+#elif defined(_BYTEORDER_NEON)
+	for (; i + 4 <= n; i += 4) {
+		uint8x16_t v = vld1q_u8((uint8_t *)(a + i));
+		vst1q_u8((uint8_t *)(a + i), vrev32q_u8(v));
+	}
+#endif
+	for (; i < n; ++i)
+		a[i] = bswap_32(a[i]);
+}
+
+static void bswap_16_array(uint16_t * a, size_t n)
+{
+	size_t i = 0;
+#if defined(_BYTEORDER_SHUFFLE) || defined(_BYTEORDER_SSE2)
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128((__m128i *)(a + i));
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		_mm_storeu_si128((__m128i *)(a + i), v);
+	}
+#elif defined(_BYTEORDER_NEON)
+	for (; i + 8 <= n; i += 8) {
+		uint8x16_t v = vld1q_u8((uint8_t *)(a + i));
+		vst1q_u8((uint8_t *)(a + i), vrev16q_u8(v));
+	}
+#endif
+	for (; i < n; ++i)
+		a[i] = bswap_16(a[i]);
+}
+
+// cfb to host in place
+static void ctohs_array (uint16_t * a, size_t n)
+{
+	if (!is_little_endian())
+		bswap_16_array(a, n);
+}
+
+static void ctohl_array (uint32_t * a, size_t n)
+{
+	if (!is_little_endian())
+		bswap_32_array(a, n);
+}
+
+// host to cfb in place
+static void htocs_array (uint16_t * a, size_t n)
+{
+	ctohs_array(a, n);
+}
+
+static void htocl_array (uint32_t * a, size_t n)
+{
+	ctohl_array(a, n);
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,6 +21,59 @@ extern "C"{
 #include <errno.h>
 #include <sys/types.h>
 
+#if defined(_WIN32) && !defined(CFB_NO_MMAP)
+#define CFB_NO_MMAP
+#endif
+
+#ifndef CFB_NO_MMAP
+#include <sys/mman.h>
+#endif
+
+#if defined(_WIN32) && !defined(CFB_NO_THREADS)
+#define CFB_NO_THREADS
+#endif
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#ifndef CFB_NO_THREADS
+#include <pthread.h>
+#define _CFB_ATOMIC_INC(p)    __atomic_fetch_add((p), 1, __ATOMIC_RELAXED)
+#define _CFB_ATOMIC_ADD(p, v) __atomic_fetch_add((p), (v), __ATOMIC_RELAXED)
+#define _CFB_ATOMIC_GET(p)    __atomic_load_n((p), __ATOMIC_RELAXED)
+#define _CFB_ATOMIC_SET(p, v) __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#else
+#define _CFB_ATOMIC_INC(p)    ((*(p))++)
+#define _CFB_ATOMIC_ADD(p, v) ((*(p)) += (v))
+#define _CFB_ATOMIC_GET(p)    (*(p))
+#define _CFB_ATOMIC_SET(p, v) (*(p) = (v))
+#endif
+
+#if defined(CFB_IO_URING) && defined(__linux__)
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#else
+#undef CFB_IO_URING
+#endif
+
+#ifndef CFB_NO_SIMD
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#define _CFB_SIMD_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define _CFB_SIMD_NEON
+#endif
+#endif
+
+#ifdef CFB_STATS
+#include <time.h>
+#endif
+
 #include "byteorder.h"
 #include "log.h"
 
@@ -411,17 +464,250 @@ static const unsigned char cfb_signature[8]     =
 static const unsigned char cfb_signature_old[8] = 
 {0x0e, 0x11, 0xfc, 0x0d, 0xd0, 0xcf, 0x11, 0xe0};
 
+/*
+ * Stream reader
+ * Random access to stream data without copy: sector chain
+ * of stream is resolved from FAT/miniFAT at open and logical
+ * offsets are mapped to sectors on each read.
+ */
+// buffer size to copy stream data if file is not mapped
+#ifndef CFB_COPY_BUFSIZE
+#define CFB_COPY_BUFSIZE (256 * 1024)
+#endif
+
+struct _cfb_geometry;
+
+typedef struct cfb_stream {
+	struct cfb * cfb;  // compound file
+	cfb_dir dir;       // directory entry of stream
+	bool mini;         // stream is in ministream
+	DWORD ssize;       // sector size - mini sector for ministream
+	DWORD shift;       // log2 of ssize
+	const struct _cfb_geometry * geom; // routines for sector size
+	SECT * sects;      // sectors of stream
+	FSINDEX sectn;     // number of sectors
+	bool borrowed;     // sects is buffer of cfb (not freed at close)
+} cfb_stream;
+
+// index entry of directory: SID of entry and SID of
+// storage it belongs to
+struct cfb_dirhash {
+	SID sid;
+	SID parent;
+};
+
+// no SID in directory tree
+static const SID NOSTREAM = 0xFFFFFFFF;
+
+/*
+ * I/O backend
+ * All reads of compound file go through read_at of backend,
+ * so file may be stored anywhere (remote storage, archive,
+ * etc) - only header, FAT, directory and sectors of streams
+ * that are read are requested. read_at should be thread
+ * safe to read streams from many threads.
+ */
+// max number of reads in one batch
+#ifndef CFB_IOVEC_MAX
+#define CFB_IOVEC_MAX 16
+#endif
+
+// bytes of stream to read ahead of current position
+#ifndef CFB_READAHEAD
+#define CFB_READAHEAD (1024 * 1024)
+#endif
+
+// one read of batch: len bytes from offset off to buf
+struct cfb_iovec {
+	off_t off;
+	void * buf;
+	size_t len;
+};
+
+// extent of file: len bytes from offset off
+struct cfb_extent {
+	off_t off;
+	size_t len;
+};
+
+struct cfb_io {
+	void * ctx;        // context of backend
+	// read len bytes from offset off to buf, return 0 on success
+	int (*read_at)(void * ctx, off_t off, void * buf, size_t len);
+	// optional: read batch of n reads, return 0 on success
+	int (*read_vec)(void * ctx, const struct cfb_iovec * vec, int n);
+	// optional: hint that n extents will be read soon - backend
+	// may start to read them (must not block)
+	void (*readahead)(void * ctx, const struct cfb_extent * ext, int n);
+	// optional: all file data in memory - streams are read
+	// without copy (cfb_stream_map)
+	const uint8_t * data;
+	size_t size;       // size of data or file (0 if not known)
+	// optional: free backend in cfb_close
+	void (*close)(void * ctx);
+};
+
+/*
+ * Sector cache
+ * Pages of sector size read from backend are kept in memory
+ * (not more then budget bytes) and evicted with CLOCK, so
+ * repeated reads of the same sectors (FAT lookups with
+ * CFB_NO_FAT_CACHE, miniFAT, random reads of streams) do not
+ * read file again. Large reads are not cached. Files in
+ * memory are not cached.
+ */
+// reads of more bytes bypass cache
+#ifndef CFB_CACHE_MAXREAD
+#define CFB_CACHE_MAXREAD (64 * 1024)
+#endif
+
+struct cfb_cache_page {
+	uint64_t page;    // index of page in file
+	uint8_t * buf;    // data of page
+	ULONG next;       // next page in hash chain
+	bool ref;         // page was used since last CLOCK pass
+};
+
+struct cfb_cache {
+	DWORD psize;      // size of page (sector size)
+	ULONG npages;     // max number of pages
+	ULONG used;       // number of pages
+	ULONG hand;       // CLOCK hand
+	struct cfb_cache_page * pages;
+	ULONG * hash;     // first page of hash chain
+	ULONG hashn;      // size of hash (power of 2)
+	uint64_t hits;    // reads from cache
+	uint64_t misses;  // reads from backend
+#ifndef CFB_NO_THREADS
+	pthread_mutex_t lock;
+#endif
+};
+
+// options of cfb_open_ex
+struct cfb_options {
+	size_t cache_size; // budget of sector cache in bytes (0 - no cache)
+	// allocator of tables, buffers and sector lists (NULL -
+	// malloc/free), should be thread-safe if streams are read
+	// from many threads; release may be NULL (arena is freed by
+	// caller after cfb_close)
+	void * (*alloc)(void * alloc_ctx, size_t size);
+	void (*release)(void * alloc_ctx, void * ptr);
+	void * alloc_ctx;
+};
+
+/*
+ * Instrumentation
+ * With CFB_STATS defined cfb counts reads of backend and
+ * lookups of tables and times phases of open, counters are
+ * relaxed atomics. Without it the macros below are empty and
+ * cfb_get_stats returns zeros.
+ */
+struct cfb_stats {
+	uint64_t seeks;        // backend reads not following previous one
+	uint64_t reads;        // backend read calls (batch counts each read)
+	uint64_t bytes;        // bytes read from backend
+	uint64_t fat_lookups;  // next sector lookups in FAT
+	uint64_t mfat_lookups; // next sector lookups in miniFAT
+	uint64_t difat_hops;   // DIFAT sectors read
+	uint64_t dir_reads;    // directory entries read
+	uint64_t cache_hits;   // reads of sector cache pages from cache
+	uint64_t cache_misses; // reads of sector cache pages from file
+	uint64_t ns_header;    // time to read and check header
+	uint64_t ns_fat;       // time to load DIFAT, FAT and miniFAT
+	uint64_t ns_dir;       // time to load and index directory
+	uint64_t ns_mstream;   // time to open ministream
+};
+
+#ifdef CFB_STATS
+static uint64_t _cfb_stats_now(){
+	struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+	timespec_get(&ts, TIME_UTC);
+#endif
+	return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+#define _CFB_STAT_ADD(cfb, field, n) _CFB_ATOMIC_ADD(&(cfb)->stats.field, (n))
+#define _CFB_STAT_INC(cfb, field)    _CFB_ATOMIC_INC(&(cfb)->stats.field)
+#define _CFB_STAT_START(t)           uint64_t t = _cfb_stats_now()
+#define _CFB_STAT_TIME(cfb, field, t) \
+	_CFB_STAT_ADD(cfb, field, _cfb_stats_now() - (t))
+// count read of len bytes at offset off
+#define _CFB_STAT_READ(cfb, off, len) do { \
+	uint64_t _o = (uint64_t)(off); \
+	if (_CFB_ATOMIC_GET(&(cfb)->stats_pos) != _o) \
+		_CFB_STAT_INC(cfb, seeks); \
+	_CFB_ATOMIC_SET(&(cfb)->stats_pos, _o + (len)); \
+	_CFB_STAT_INC(cfb, reads); \
+	_CFB_STAT_ADD(cfb, bytes, (len)); \
+} while (0)
+#else
+#define _CFB_STAT_ADD(cfb, field, n)
+#define _CFB_STAT_INC(cfb, field)
+#define _CFB_STAT_START(t)
+#define _CFB_STAT_TIME(cfb, field, t)
+#define _CFB_STAT_READ(cfb, off, len)
+#endif
+
+#ifndef CFB_NO_MMAP
+// mapping - address and size of mapped file
+struct _cfb_io_mmap {
+	void * addr;
+	size_t len;
+};
+#endif
+
 /*
  * MS-CMF structure
  * countain file header, root dir header and pointers to
  * streams
  */
 struct cfb {
-	FILE * fp;         // pointer to file
-	FILE * ministream; // pointer to ministream
+	struct cfb_io io;  // I/O backend
+	struct cfb_options options; // options of open
+	struct cfb_cache cache; // sector cache (npages is 0 if no cache)
+	cfb_stream mstream; // ministream - opened on first access
+	bool mstream_ready; // ministream is opened
+#ifndef CFB_NO_THREADS
+	pthread_mutex_t lock; // lock to open ministream
+#endif
 	cfb_header header;
 	cfb_dir root;
 	bool biteOrder;
+	SECT * difat;      // locations of FAT sectors
+	FSINDEX difatn;    // number of FAT sectors
+	SECT * fat;        // FAT loaded to memory
+	FSINDEX fatn;      // number of SECTs in FAT
+	SECT * mfatsect;   // locations of miniFAT sectors
+	FSINDEX mfatsectn; // number of miniFAT sectors
+	SECT * mfat;       // miniFAT loaded to memory
+	FSINDEX mfatn;     // number of SECTs in miniFAT
+	cfb_dir * dirs;    // directory loaded to memory
+	SID dirn;          // number of directory entries
+	struct cfb_dirhash * dirhash; // index of directory by name
+	ULONG dirhashn;    // size of index (power of 2)
+	bool damaged;      // broken chains were truncated at open
+	// capacity of buffers in bytes - buffers are kept by
+	// cfb_reset and reused by next file
+	size_t difatcap, fatcap, mfatsectcap, mfatcap, dirscap, dirhashcap;
+	void * scratch;    // bitmaps and sector lists of open
+	size_t scratchcap;
+	SECT * msects;     // sectors of ministream
+	size_t msectscap;
+#ifndef CFB_NO_MMAP
+	struct _cfb_io_mmap map; // mapping of file opened with cfb_reopen
+#endif
+	// sidecar index (cfb_index.h) - tables point to index and
+	// are not freed, sector lists of streams are taken from it
+	void * index;
+	void (*index_close)(void * index);
+	const SECT * (*index_chain)(void * index, const cfb_dir * dir, 
+			bool mini, FSINDEX * n);
+#ifdef CFB_STATS
+	struct cfb_stats stats; // counters of instrumentation
+	uint64_t stats_pos; // end of last backend read
+#endif
 };
 
 // error codes
@@ -437,393 +723,1432 @@ enum {
 	CFB_HEADER_ERR = 0x80,       // error in file header
 	CFB_DIF_ERR = 0x100,         // error in DIF
 	CFB_ALLOC_ERR = 0x200,       // error in alloc
+	CFB_INDEX_ERR = 0x400,       // no sidecar index or it is not valid
 };
 
 /*
  * IMP
  */
 
+// allocate size bytes with allocator of options
+static void * _cfb_alloc(struct cfb * cfb, size_t size){
+	if (cfb->options.alloc)
+		return cfb->options.alloc(cfb->options.alloc_ctx, size);
+	return malloc(size);
+}
+
+static void _cfb_free(struct cfb * cfb, void * ptr){
+	if (!ptr)
+		return;
+	if (cfb->options.alloc){
+		if (cfb->options.release)
+			cfb->options.release(cfb->options.alloc_ctx, ptr);
+		return;
+	}
+	free(ptr);
+}
+
+// get buffer *ptr of at least size bytes - buffer of
+// capacity *cap is reused if it is large enough
+static void * _cfb_buf(struct cfb * cfb, void ** ptr, size_t * cap, 
+		size_t size)
+{
+	if (*ptr && *cap >= size)
+		return *ptr;
+	_cfb_free(cfb, *ptr);
+	*cap = 0;
+	*ptr = _cfb_alloc(cfb, size ? size : 1);
+	if (*ptr)
+		*cap = size;
+	return *ptr;
+}
+
+// fields from _sidLeftSib [044H] to _ulSize [078H] are 14
+// DWORDs in a row and swapped in one pass
 static void _cfb_dir_sw(cfb_dir * dir){
 	
 	dir->_cb = bswap_16(dir->_cb);
-	
-	dir->_sidLeftSib = bswap_32(dir->_sidLeftSib);
-	dir->_sidRightSib = bswap_32(dir->_sidRightSib);
-	dir->_sidChild = bswap_32(dir->_sidChild);
-	
-	dir->_clsId.a = bswap_32(dir->_clsId.a); 
-	dir->_clsId.b = bswap_32(dir->_clsId.b); 
-	dir->_clsId.c = bswap_32(dir->_clsId.c); 
-	dir->_clsId.d = bswap_32(dir->_clsId.d); 
-
-	dir->_dwUserFlags = bswap_32(dir->_dwUserFlags);
-	dir->_time[0].dwLowDateTime = bswap_32(dir->_time[0].dwLowDateTime);
-	dir->_time[0].dwHighDateTime = bswap_32(dir->_time[0].dwHighDateTime);
-	dir->_time[1].dwLowDateTime = bswap_32(dir->_time[1].dwLowDateTime);
-	dir->_time[1].dwHighDateTime = bswap_32(dir->_time[1].dwHighDateTime);	
-
-	dir->_sectStart = bswap_32(dir->_sectStart);
-	dir->_ulSize = bswap_32(dir->_ulSize);
+	bswap_32_array(&dir->_sidLeftSib, 14);
 	dir->_dptPropType = bswap_16(dir->_dptPropType);
 }
 
-//return len of utf8 string
-static size_t _utf16_to_utf8(WORD * utf16, int len, char * utf8){
-	int i, k = 0;
-	for (i = 0; i < len; ++i) {
-		WORD wc = utf16[i];
-		if (wc <= 0x7F) {
-			// Plain single-byte ASCII.
-			utf8[k++] = (char) wc;
-		}
-		else if (wc <= 0x7FF) {
-			// Two bytes.
-			utf8[k++] = 0xC0 |  (wc >> 6);
-			utf8[k++] = 0x80 | ((wc >> 0) & 0x3F);
-		}
-		else if (wc <= 0xFFFF) {
-			// Three bytes.
-			utf8[k++] = 0xE0 |  (wc >> 12);
-			utf8[k++] = 0x80 | ((wc >> 6) & 0x3F);
-			utf8[k++] = 0x80 | ((wc >> 0) & 0x3F);
-		}
-		else{
-			// Invalid char; don't encode anything.
-		}
-	}
-	//null-terminate
-	utf8[k] = 0;	
-
-	return k;
+/*
+ * Backends
+ */
+// memory buffer - ctx is data (bounds are checked in _cfb_read)
+static int _cfb_io_mem_read(void * ctx, off_t off, void * buf, size_t len){
+	memcpy(buf, (const uint8_t *)ctx + off, len);
+	return 0;
 }
 
 /*
- * The FAT is the main allocator for space within a compound
- * file. Every sector in the file is represented within the
- * FAT in some fashion, including those sectors that are
- * unallocated
- *(free). The FAT is a sector chain that is made up of one
- or more FAT sectors.
+ * Set backend to read from buffer in memory. Data is not
+ * copied and should be valid until cfb_close
  */
+static void cfb_io_mem(struct cfb_io * io, const void * data, size_t len){
+	memset(io, 0, sizeof(struct cfb_io));
+	io->ctx = (void *)data;
+	io->read_at = _cfb_io_mem_read;
+	io->data = (const uint8_t *)data;
+	io->size = len;
+}
 
-static SECT _cfb_next_sect_in_FAT_chain(SECT sect, struct cfb * cfb){
-/*
- * The FAT is an array of sector numbers that represent the
- * allocation of space within the file, grouped into FAT
- * sectors. Each stream is represented in the FAT by a
- * sector chain, in much the same fashion as a FAT file
- * system.
- */	
-#ifdef DEBUG
-	LOG("get next SECT in FAT chain for: 0x%x:\t", sect);
-#endif		
+#ifndef _WIN32
+// size of regular file or 0 (bound of sectors in _cfb_validate)
+static size_t _cfb_io_fsize(int fd){
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode))
+		return 0;
+	return (size_t)st.st_size;
+}
+#endif
+
+// stdio - ctx is FILE
+static int _cfb_io_stdio_read(void * ctx, off_t off, void * buf, size_t len){
+	FILE * fp = (FILE *)ctx;
+#ifndef CFB_NO_THREADS
+	// positional read does not change file position, so
+	// streams may be read from many threads
+	int fd = fileno(fp);
+	while (len > 0) {
+		ssize_t n = pread(fd, buf, len, off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf = (char *)buf + n;
+		len -= n;
+		off += n;
+	}
+#else
+	if (fseeko(fp, off, SEEK_SET))
+		return -1;
+	if (fread(buf, len, 1, fp) != 1)
+		return -1;
+#endif
+	return 0;
+}
+
+#ifndef _WIN32
+// ask kernel to read extents of file to page cache
+static void _cfb_fadvise(int fd, const struct cfb_extent * ext, int n){
+#ifdef POSIX_FADV_WILLNEED
 	int i;
+	for (i = 0; i < n; ++i)
+		posix_fadvise(fd, ext[i].off, ext[i].len, POSIX_FADV_WILLNEED);
+#endif
+}
 
-	if (sect > MAXSECT)
-		return ENDOFCHAIN;	
+static void _cfb_io_stdio_readahead(void * ctx, const struct cfb_extent * ext, 
+		int n)
+{
+	_cfb_fadvise(fileno((FILE *)ctx), ext, n);
+}
+#endif
+
+static void _cfb_io_stdio_close(void * ctx){
+	fclose((FILE *)ctx);
+}
 
 /*
- * If Header Major Version is 3, there MUST be 128 fields
- * specified to fill a 512-byte sector.  If Header Major
- * Version is 4, there MUST be 1,024 fields specified to
- * fill a 4,096-byte sector.
- */	
-	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size
-	FSINDEX SECTn = ssize/4; // number of sectors in FAT
+ * Set backend to read from FILE (with pread on file
+ * descriptor, or fseek/fread if CFB_NO_THREADS). If own is
+ * true FILE is closed in cfb_close
+ */
+static void cfb_io_stdio(struct cfb_io * io, FILE * fp, bool own){
+	memset(io, 0, sizeof(struct cfb_io));
+	io->ctx = fp;
+	io->read_at = _cfb_io_stdio_read;
+#ifndef _WIN32
+	io->readahead = _cfb_io_stdio_readahead;
+	io->size = _cfb_io_fsize(fileno(fp));
+#endif
+	if (own)
+		io->close = _cfb_io_stdio_close;
+}
 
-/* The DIFAT sectors are linked together by the last field
- * in each DIFAT sector. As an optimization, the first 109
- * FAT sectors are represented within the header itself.  No
- * DIFAT sectors are needed in a compound file that is
- * smaller than 6.875 megabytes (MB) for a 512-byte sector
- * compound file (6.875 MB = (1 header sector + 109 FAT
- * sectors x 128 non-empty entries) × 512 bytes per sector).
- */ 
-	if (sect < ssize * 109){ // FAT is in header
+#ifndef _WIN32
+// file descriptor - ctx is fd
+static int _cfb_io_fd_read(void * ctx, off_t off, void * buf, size_t len){
+	int fd = (int)(intptr_t)ctx;
+	while (len > 0) {
+		ssize_t n = pread(fd, buf, len, off);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf = (char *)buf + n;
+		len -= n;
+		off += n;
+	}
+	return 0;
+}
 
-		FSINDEX FAT_INDEX = sect / SECTn;
-		FSINDEX SECT_INDEX = sect - (FAT_INDEX * SECTn);
+static void _cfb_io_fd_readahead(void * ctx, const struct cfb_extent * ext, 
+		int n)
+{
+	_cfb_fadvise((int)(intptr_t)ctx, ext, n);
+}
 
-		// get SECT offset
-		SECT FAT = cfb->header._sectFat[FAT_INDEX];
-		if (cfb->biteOrder) 
-			FAT = bswap_32(FAT);		
-		DWORD off = 
-			FAT * ssize + ssize
-			+ SECT_INDEX * 4;
-		// seek to offset
-		fseek(cfb->fp, off, SEEK_SET);
-
-		// read sect
-		SECT ch;
-		if (fread(&ch, 4, 1, cfb->fp) != 1){
-#ifdef DEBUG
-	LOG("Error to read SECT from offset: %u", off);
-#endif		
-			return ENDOFCHAIN;
-		};
-		if (cfb->biteOrder) 
-			ch = bswap_32(ch);		
+static void _cfb_io_fd_close(void * ctx){
+	close((int)(intptr_t)ctx);
+}
 
-#ifdef DEBUG
-	LOG("0x%x", ch);
-#endif		
-		return ch;
+/*
+ * Set backend to read from file descriptor with pread. If
+ * own is true fd is closed in cfb_close
+ */
+static void cfb_io_fd(struct cfb_io * io, int fd, bool own){
+	memset(io, 0, sizeof(struct cfb_io));
+	io->ctx = (void *)(intptr_t)fd;
+	io->read_at = _cfb_io_fd_read;
+	io->readahead = _cfb_io_fd_readahead;
+	io->size = _cfb_io_fsize(fd);
+	if (own)
+		io->close = _cfb_io_fd_close;
+}
+#endif
 
-	} 
-// FAT is in DIFAT
+#ifndef CFB_NO_MMAP
+static void _cfb_io_mmap_readahead(void * ctx, const struct cfb_extent * ext, 
+		int n)
+{
+#ifdef MADV_WILLNEED
+	struct _cfb_io_mmap * m = (struct _cfb_io_mmap *)ctx;
+	off_t page = sysconf(_SC_PAGESIZE);
+	int i;
+	for (i = 0; i < n; ++i) {
+		// madvise needs address aligned to page
+		off_t off = ext[i].off - ext[i].off % page;
+		if ((size_t)off >= m->len)
+			continue;
+		size_t len = ext[i].len + (ext[i].off - off);
+		if (len > m->len - off)
+			len = m->len - off;
+		madvise((uint8_t *)m->addr + off, len, MADV_WILLNEED);
+	}
+#endif
+}
 
-/* DIFAT
- * double-indirect file allocation table (DIFAT): A
- * structure that is used to locate FAT sectors in a
- * compound file.
- *
- *		FAT Sector Location (variable): This field specifies
- *		the FAT sector number in a DIFAT.  If Header Major
- *		Version is 3, there MUST be 127 fields specified to
- *		fill a 512-byte sector minus the "Next DIFAT Sector
- *		Location" field.  If Header Major Version is 4, there
- *		MUST be 1,023 fields specified to fill a 4,096-byte
- *		sector minus the "Next DIFAT Sector Location" field.
-*/	
-	
-	FSINDEX FATn = 127; //number of FAT sectors in DIFAT
-	if (cfb->header._uDllVersion == 4)
-		FATn = 1023;
-	
-	FSINDEX DIFAT_INDEX = (sect - SECTn * 109) / FATn * SECTn;
-	FSINDEX FAT_INDEX   = sect - (SECTn * 109) - (DIFAT_INDEX * SECTn);
-	FSINDEX SECT_INDEX  = sect - (SECTn * 109) - (DIFAT_INDEX * SECTn) - (FAT_INDEX * SECTn);
+static void _cfb_io_mmap_unmap(void * ctx){
+	struct _cfb_io_mmap * m = (struct _cfb_io_mmap *)ctx;
+	munmap(m->addr, m->len);
+}
 
-	// get DIFAT 
-	SECT DIFAT = cfb->header._sectDifStart;
-	for (i = 0; i < DIFAT_INDEX; ++i) {
-		// next DIFAT is in 128 (1024) field 
-		DWORD off = DIFAT * ssize + ssize + (FATn * 4); 
-		fseek(cfb->fp, off, SEEK_SET);
-		SECT ch;
-		if (fread(&ch, 4, 1, cfb->fp) != 1){
+static void _cfb_io_mmap_close(void * ctx){
+	_cfb_io_mmap_unmap(ctx);
+	free(ctx);
+}
+
+// map file to m and set backend to it (mapping is not
+// closed), return 0 or -1
+static int _cfb_io_mmap_init(struct cfb_io * io, int fd, struct _cfb_io_mmap * m){
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size < 512)
+		return -1;
+	m->len = st.st_size;
+	m->addr = mmap(NULL, m->len, PROT_READ, MAP_SHARED, fd, 0);
+	if (m->addr == MAP_FAILED){
 #ifdef DEBUG
-	LOG("Error to read DIFAT from offset: %u", off);
+	LOG("can't mmap file");
 #endif		
-			return ENDOFCHAIN;
-		};
-		if (cfb->biteOrder) 
-			ch = bswap_32(ch);
-		DIFAT = ch;	
+		return -1;
 	}
-	// get FAT 
-	SECT FAT;
-	DWORD off = DIFAT * ssize + ssize + (FAT_INDEX * 4); 
-	fseek(cfb->fp, off, SEEK_SET);
-	SECT ch;
-	if (fread(&ch, 4, 1, cfb->fp) != 1){
-#ifdef DEBUG
-	LOG("Error to read FAT from offset: %u", off);
-#endif		
-		return ENDOFCHAIN;
-	};
-	if (cfb->biteOrder) 
-		ch = bswap_32(ch);
-	FAT = ch;	
+	cfb_io_mem(io, m->addr, m->len);
+	io->ctx = m;
+	io->read_at = NULL; // data is always read from memory
+	io->readahead = _cfb_io_mmap_readahead;
+	return 0;
+}
 
-	// get SECT offset
-	off = FAT * ssize + ssize + (SECT_INDEX * 4);
-	// seek to offset
-	fseek(cfb->fp, off, SEEK_SET);
-	if (fread(&ch, 4, 1, cfb->fp) != 1){
+/*
+ * Set backend to file mapped to memory with mmap (fd may be
+ * closed after that). Return 0 on success or -1 if file
+ * can't be mapped (pipes, etc)
+ */
+static int cfb_io_mmap(struct cfb_io * io, int fd){
+	struct _cfb_io_mmap * m = 
+		(struct _cfb_io_mmap *)malloc(sizeof(struct _cfb_io_mmap));
+	if (!m)
+		return -1;
+	if (_cfb_io_mmap_init(io, fd, m)){
+		free(m);
+		return -1;
+	}
+	io->close = _cfb_io_mmap_close;
+	return 0;
+}
+#endif
+
+// read len bytes from offset of file to buf with backend,
+// return 0 on success
+static int _cfb_read_io(struct cfb * cfb, off_t off, void * buf, size_t len){
+	if (cfb->io.data){
+		if (off < 0 || (size_t)off > cfb->io.size || len > cfb->io.size - off){
 #ifdef DEBUG
-	LOG("Error to read SECT from offset: %u", off);
+	LOG("Error to read %zu bytes from offset: %lld", len, (long long)off);
 #endif		
-		return ENDOFCHAIN;
-	};
-	if (cfb->biteOrder) 
-		ch = bswap_32(ch);
+			return -1;
+		}
+		_CFB_STAT_READ(cfb, off, len);
+		memcpy(buf, cfb->io.data + off, len);
+		return 0;
+	}
+	_CFB_STAT_READ(cfb, off, len);
+	if (cfb->io.read_at(cfb->io.ctx, off, buf, len)){
 #ifdef DEBUG
-	LOG("0x%x", ch);
+	LOG("Error to read %zu bytes from offset: %lld", len, (long long)off);
 #endif		
-	return ch;	
+		return -1;
+	}
+	return 0;
 }
 
-static SECT _cfb_next_sect_in_mFAT_chain(SECT sect, struct cfb * cfb){
-/*
- *  The mini FAT is used to allocate space in the mini
- *  stream. The mini stream is divided into smaller,
- *  equal-length sectors, and the sector size that is used
- *  for the mini stream is specified from the Compound File
- *  Header (64 bytes).
- */	
-
-#ifdef DEBUG
-	LOG("get next SECT in mFAT chain for: 0x%x:\t", sect);
-#endif		
-	int i;
+// create cache of budget bytes with pages of psize bytes
+static int _cfb_cache_init(struct cfb * cfb, size_t budget, DWORD psize){
+	struct cfb_cache * cache = &cfb->cache;
+	memset(cache, 0, sizeof(struct cfb_cache));
+	if (budget / psize > 0xFFFFFFF0)
+		budget = (size_t)0xFFFFFFF0 * psize;
+	cache->npages = budget / psize;
+	if (cache->npages == 0)
+		return 0;
+	cache->psize = psize;
+	cache->hashn = 1;
+	while (cache->hashn < cache->npages)
+		cache->hashn <<= 1;
+	cache->pages = (struct cfb_cache_page *)_cfb_alloc(cfb,
+			cache->npages * sizeof(struct cfb_cache_page));
+	cache->hash = (ULONG *)_cfb_alloc(cfb, cache->hashn * sizeof(ULONG));
+	if (!cache->pages || !cache->hash){
+		ERR("malloc");
+		_cfb_free(cfb, cache->pages);
+		_cfb_free(cfb, cache->hash);
+		memset(cache, 0, sizeof(struct cfb_cache));
+		return CFB_ALLOC_ERR;
+	}
+	memset(cache->pages, 0, cache->npages * sizeof(struct cfb_cache_page));
+	memset(cache->hash, 0xFF, cache->hashn * sizeof(ULONG));
+#ifndef CFB_NO_THREADS
+	pthread_mutex_init(&cache->lock, NULL);
+#endif
+	return 0;
+}
 
-	if (sect > MAXSECT)
-		return ENDOFCHAIN;	
+static void _cfb_cache_free(struct cfb * cfb){
+	struct cfb_cache * cache = &cfb->cache;
+	ULONG i;
+	if (cache->npages == 0)
+		return;
+	// buffers of pages are kept by _cfb_cache_clear
+	for (i = 0; i < cache->npages && cache->pages[i].buf; ++i)
+		_cfb_free(cfb, cache->pages[i].buf);
+	_cfb_free(cfb, cache->pages);
+	_cfb_free(cfb, cache->hash);
+#ifndef CFB_NO_THREADS
+	pthread_mutex_destroy(&cache->lock);
+#endif
+	memset(cache, 0, sizeof(struct cfb_cache));
+}
 
-/*
- * The mini stream is chained within the FAT in exactly the
- * same fashion as any normal stream.  The mini stream's
- * starting sector is referenced in the first directory
- * entry (root storage stream ID 0).
- */	
-	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size - for mFAT it is 512(4096)
-	FSINDEX SECTn = ssize/4; // number of sectors in mFAT
-	
-	FSINDEX mFAT_INDEX = sect / SECTn;
-	FSINDEX SECT_INDEX = sect - (mFAT_INDEX * SECTn);
+// remove all pages from cache - buffers of pages are kept
+// to be reused for next file
+static void _cfb_cache_clear(struct cfb_cache * cache){
+	if (cache->npages == 0)
+		return;
+	cache->used = 0;
+	cache->hand = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+	memset(cache->hash, 0xFF, cache->hashn * sizeof(ULONG));
+}
 
-	// get FAT 
-	SECT mFAT = cfb->header._sectMiniFatStart;
-	for (i = 0; i < mFAT_INDEX; ++i) {
-		// next mFAT is in FAT chain
-		mFAT = _cfb_next_sect_in_FAT_chain(mFAT, cfb); 
+// find page in cache (lock should be held), return NULL if
+// page is not in cache
+static struct cfb_cache_page * _cfb_cache_find(struct cfb_cache * cache, 
+		uint64_t page)
+{
+	ULONG i = cache->hash[page & (cache->hashn - 1)];
+	while (i != 0xFFFFFFFF) {
+		if (cache->pages[i].page == page)
+			return &cache->pages[i];
+		i = cache->pages[i].next;
 	}
-	
+	return NULL;
+}
+
+// add data of page to cache (lock should be held) - free
+// page is used or page is evicted with CLOCK
+static void _cfb_cache_add(struct cfb * cfb, uint64_t page, 
+		const uint8_t * data)
+{
+	struct cfb_cache * cache = &cfb->cache;
+	ULONG i;
+	if (cache->used < cache->npages){
+		if (!cache->pages[cache->used].buf){
+			uint8_t * buf = (uint8_t *)_cfb_alloc(cfb, cache->psize);
+			if (!buf)
+				return;
+			cache->pages[cache->used].buf = buf;
+		}
+		i = cache->used++;
+	} else {
+		// CLOCK - skip pages used since last pass
+		while (cache->pages[cache->hand].ref) {
+			cache->pages[cache->hand].ref = false;
+			cache->hand = (cache->hand + 1) % cache->npages;
+		}
+		i = cache->hand;
+		cache->hand = (cache->hand + 1) % cache->npages;
+		// remove from hash chain
+		ULONG * p = &cache->hash[cache->pages[i].page & (cache->hashn - 1)];
+		while (*p != i)
+			p = &cache->pages[*p].next;
+		*p = cache->pages[i].next;
+	}
+	ULONG * head = &cache->hash[page & (cache->hashn - 1)];
+	cache->pages[i].page = page;
+	cache->pages[i].next = *head;
+	cache->pages[i].ref = false;
+	*head = i;
+	memcpy(cache->pages[i].buf, data, cache->psize);
+}
+
+// read len bytes from offset of file to buf with cache,
+// return 0 on success
+static int _cfb_cache_read(struct cfb * cfb, off_t off, void * buf, size_t len){
+	struct cfb_cache * cache = &cfb->cache;
+	uint8_t data[4096]; // max sector size
+	while (len > 0) {
+		uint64_t page = off / cache->psize;
+		DWORD poff = off % cache->psize;
+		size_t n = cache->psize - poff < len ? cache->psize - poff : len;
+#ifndef CFB_NO_THREADS
+		pthread_mutex_lock(&cache->lock);
+#endif
+		struct cfb_cache_page * p = _cfb_cache_find(cache, page);
+		if (p){
+			p->ref = true;
+			memcpy(buf, p->buf + poff, n);
+			cache->hits++;
+		} else
+			cache->misses++;
+#ifndef CFB_NO_THREADS
+		pthread_mutex_unlock(&cache->lock);
+#endif
+		if (!p){
+			// read page without lock
+			if (_cfb_read_io(cfb, (off_t)page * cache->psize, data, cache->psize)){
+				// page is not full at end of file
+				if (_cfb_read_io(cfb, off, buf, len))
+					return -1;
+				return 0;
+			}
+			memcpy(buf, data + poff, n);
+#ifndef CFB_NO_THREADS
+			pthread_mutex_lock(&cache->lock);
+#endif
+			if (!_cfb_cache_find(cache, page))
+				_cfb_cache_add(cfb, page, data);
+#ifndef CFB_NO_THREADS
+			pthread_mutex_unlock(&cache->lock);
+#endif
+		}
+		buf = (uint8_t *)buf + n;
+		off += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * function `cfb_cache_stats`
+ * Get number of reads of cache pages from cache (hits) and
+ * from file (misses)
+ */
+static void cfb_cache_stats(struct cfb * cfb, uint64_t * hits, uint64_t * misses){
+#ifndef CFB_NO_THREADS
+	if (cfb->cache.npages)
+		pthread_mutex_lock(&cfb->cache.lock);
+#endif
+	*hits = cfb->cache.hits;
+	*misses = cfb->cache.misses;
+#ifndef CFB_NO_THREADS
+	if (cfb->cache.npages)
+		pthread_mutex_unlock(&cfb->cache.lock);
+#endif
+}
+
+/*
+ * Get counters of instrumentation (zeros if cfb is compiled
+ * without CFB_STATS), return 0 or -1 if stats are disabled
+ */
+static int cfb_get_stats(struct cfb * cfb, struct cfb_stats * stats){
+	memset(stats, 0, sizeof(struct cfb_stats));
+#ifdef CFB_STATS
+	stats->seeks        = _CFB_ATOMIC_GET(&cfb->stats.seeks);
+	stats->reads        = _CFB_ATOMIC_GET(&cfb->stats.reads);
+	stats->bytes        = _CFB_ATOMIC_GET(&cfb->stats.bytes);
+	stats->fat_lookups  = _CFB_ATOMIC_GET(&cfb->stats.fat_lookups);
+	stats->mfat_lookups = _CFB_ATOMIC_GET(&cfb->stats.mfat_lookups);
+	stats->difat_hops   = _CFB_ATOMIC_GET(&cfb->stats.difat_hops);
+	stats->dir_reads    = _CFB_ATOMIC_GET(&cfb->stats.dir_reads);
+	stats->ns_header    = _CFB_ATOMIC_GET(&cfb->stats.ns_header);
+	stats->ns_fat       = _CFB_ATOMIC_GET(&cfb->stats.ns_fat);
+	stats->ns_dir       = _CFB_ATOMIC_GET(&cfb->stats.ns_dir);
+	stats->ns_mstream   = _CFB_ATOMIC_GET(&cfb->stats.ns_mstream);
+	cfb_cache_stats(cfb, &stats->cache_hits, &stats->cache_misses);
+	return 0;
+#else
+	(void)cfb;
+	return -1;
+#endif
+}
+
+// read len bytes from offset of file to buf, return 0 on success
+static int _cfb_read(struct cfb * cfb, off_t off, void * buf, size_t len){
+	if (cfb->cache.npages && len <= CFB_CACHE_MAXREAD)
+		return _cfb_cache_read(cfb, off, buf, len);
+	return _cfb_read_io(cfb, off, buf, len);
+}
+
+// read batch of n reads - with read_vec of backend if it is
+// set, return 0 on success
+static int _cfb_read_vec(struct cfb * cfb, const struct cfb_iovec * vec, int n){
+	int i;
+	if (n == 0)
+		return 0;
+	// with cache reads are done one by one
+	if (!cfb->io.data && cfb->io.read_vec && !cfb->cache.npages){
+#ifdef CFB_STATS
+		for (i = 0; i < n; ++i)
+			_CFB_STAT_READ(cfb, vec[i].off, vec[i].len);
+#endif
+		if (cfb->io.read_vec(cfb->io.ctx, vec, n)){
+#ifdef DEBUG
+	LOG("Error to read batch of %d reads", n);
+#endif		
+			return -1;
+		}
+		return 0;
+	}
+	for (i = 0; i < n; ++i)
+		if (_cfb_read(cfb, vec[i].off, vec[i].buf, vec[i].len))
+			return -1;
+	return 0;
+}
+
+// read n sectors of file to buf - runs of contiguous sectors
+// are read with one read, and reads are batched
+static int _cfb_read_sects(struct cfb * cfb, const SECT * sects, FSINDEX n, 
+		void * buf)
+{
+	DWORD ssize = 1 << cfb->header._uSectorShift;
+	struct cfb_iovec vec[CFB_IOVEC_MAX];
+	int nvec = 0;
+	FSINDEX i = 0;
+	while (i < n) {
+		FSINDEX k = 1;
+		while (i + k < n && sects[i + k] == sects[i] + k)
+			k++;
+		vec[nvec].off = (off_t)sects[i] * ssize + ssize;
+		vec[nvec].buf = (uint8_t *)buf + (size_t)i * ssize;
+		vec[nvec].len = (size_t)k * ssize;
+		if (++nvec == CFB_IOVEC_MAX){
+			if (_cfb_read_vec(cfb, vec, nvec))
+				return -1;
+			nvec = 0;
+		}
+		i += k;
+	}
+	return _cfb_read_vec(cfb, vec, nvec);
+}
+
+// copy run of ASCII WORDs as bytes with SIMD; return number
+// of WORDs copied (stop at first non-ASCII block)
+static int _utf16_ascii_run(const WORD * utf16, int len, char * utf8){
+	int i = 0;
+#if defined(_CFB_SIMD_SSE2)
+#ifdef __AVX2__
+	const __m256i hi256 = _mm256_set1_epi16((short)0xFF80);
+	for (; i + 16 <= len; i += 16) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(utf16 + i));
+		if (!_mm256_testz_si256(v, hi256))
+			break;
+		__m128i b = _mm_packus_epi16(_mm256_castsi256_si128(v),
+				_mm256_extracti128_si256(v, 1));
+		_mm_storeu_si128((__m128i *)(utf8 + i), b);
+	}
+#endif
+	const __m128i hi = _mm_set1_epi16((short)0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= len; i += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(utf16 + i));
+		__m128i z = _mm_cmpeq_epi16(_mm_and_si128(v, hi), zero);
+		if (_mm_movemask_epi8(z) != 0xFFFF)
+			break;
+		_mm_storel_epi64((__m128i *)(utf8 + i), _mm_packus_epi16(v, v));
+	}
+#elif defined(_CFB_SIMD_NEON)
+	const uint16x8_t hi = vdupq_n_u16(0xFF80);
+	for (; i + 8 <= len; i += 8) {
+		uint16x8_t v = vld1q_u16(utf16 + i);
+		uint64x2_t t = vreinterpretq_u64_u16(vandq_u16(v, hi));
+		if (vgetq_lane_u64(t, 0) | vgetq_lane_u64(t, 1))
+			break;
+		vst1_u8((uint8_t *)(utf8 + i), vmovn_u16(v));
+	}
+#endif
+	return i;
+}
+
+//return len of utf8 string
+//utf8 must have space for 3 bytes per WORD and null
+static size_t _utf16_to_utf8(const WORD * utf16, int len, char * utf8){
+	int i = 0, k = 0;
+	while (i < len) {
+		// vectorized ASCII blocks; output offset differs from
+		// input offset once a multibyte char was written
+		int n = _utf16_ascii_run(utf16 + i, len - i, utf8 + k);
+		i += n; k += n;
+		if (i >= len)
+			break;
+
+		WORD wc = utf16[i++];
+		if (wc <= 0x7F) {
+			// Plain single-byte ASCII.
+			utf8[k++] = (char) wc;
+		}
+		else if (wc <= 0x7FF) {
+			// Two bytes.
+			utf8[k++] = 0xC0 |  (wc >> 6);
+			utf8[k++] = 0x80 | ((wc >> 0) & 0x3F);
+		}
+		else if (wc >= 0xD800 && wc <= 0xDBFF && 
+				i < len && utf16[i] >= 0xDC00 && utf16[i] <= 0xDFFF) 
+		{
+			// Surrogate pair - four bytes.
+			uint32_t cp = 0x10000 + 
+				(((uint32_t)wc - 0xD800) << 10) + (utf16[i++] - 0xDC00);
+			utf8[k++] = 0xF0 |  (cp >> 18);
+			utf8[k++] = 0x80 | ((cp >> 12) & 0x3F);
+			utf8[k++] = 0x80 | ((cp >> 6) & 0x3F);
+			utf8[k++] = 0x80 | ((cp >> 0) & 0x3F);
+		}
+		else {
+			// Three bytes; lone surrogate is replaced with U+FFFD
+			if (wc >= 0xD800 && wc <= 0xDFFF)
+				wc = 0xFFFD;
+			utf8[k++] = 0xE0 |  (wc >> 12);
+			utf8[k++] = 0x80 | ((wc >> 6) & 0x3F);
+			utf8[k++] = 0x80 | ((wc >> 0) & 0x3F);
+		}
+	}
+	//null-terminate
+	utf8[k] = 0;	
+
+	return k;
+}
+
+//return len of utf16 string or -1 if utf8 is not valid
+//or does not fit - len is max number of WORDs in utf16
+static int _utf8_to_utf16(const char * utf8, int len, WORD * utf16){
+	int i = 0;
+	const uint8_t *ptr = (const uint8_t *)utf8;
+	while (*ptr){ //iterate chars
+		
+		//get utf32
+		uint32_t cp, min;
+		int n, k;
+		if (*ptr < 0x80) {
+			cp = *ptr; n = 0; min = 0;
+		}
+		else if ((*ptr & 0xE0) == 0xC0) {
+			cp = *ptr & 0x1F; n = 1; min = 0x80;
+		}
+		else if ((*ptr & 0xF0) == 0xE0) {
+			cp = *ptr & 0x0F; n = 2; min = 0x800;
+		}
+		else if ((*ptr & 0xF8) == 0xF0) {
+			cp = *ptr & 0x07; n = 3; min = 0x10000;
+		}
+		else
+			return -1;
+		ptr++;
+		
+		// continuation bytes (null terminator fails the test)
+		for (k = 0; k < n; ++k) {
+			if ((*ptr & 0xC0) != 0x80)
+				return -1;
+			cp = (cp << 6) | (*ptr++ & 0x3F);
+		}
+
+		// overlong, surrogate or out of range
+		if (cp < min || (cp >= 0xD800 && cp <= 0xDFFF) || cp > 0x10FFFF)
+			return -1;
+					
+		if (cp < 0x10000) {
+			if (i + 1 > len)
+				return -1;
+			utf16[i++] = (WORD)cp;
+		} else {
+			if (i + 2 > len)
+				return -1;
+			cp -= 0x10000;
+			utf16[i++] = 0xD800 | (cp >> 10);
+			utf16[i++] = 0xDC00 | (cp & 0x3FF);
+		}
+	}
+	return i;
+}
+
+/*
+ * The FAT is the main allocator for space within a compound
+ * file. Every sector in the file is represented within the
+ * FAT in some fashion, including those sectors that are
+ * unallocated
+ *(free). The FAT is a sector chain that is made up of one
+ or more FAT sectors.
+ */
+
+static SECT _cfb_next_sect_in_FAT_chain(SECT sect, struct cfb * cfb){
+/*
+ * The FAT is an array of sector numbers that represent the
+ * allocation of space within the file, grouped into FAT
+ * sectors. Each stream is represented in the FAT by a
+ * sector chain, in much the same fashion as a FAT file
+ * system.
+ */	
+#ifdef DEBUG
+	LOG("get next SECT in FAT chain for: 0x%x:\t", sect);
+#endif		
+	_CFB_STAT_INC(cfb, fat_lookups);
+
+	if (sect > MAXSECT)
+		return ENDOFCHAIN;	
+
+#ifndef CFB_NO_FAT_CACHE
+	// FAT is loaded to memory in _cfb_init
+	if (sect >= cfb->fatn)
+		return ENDOFCHAIN;
+#ifdef DEBUG
+	LOG("0x%x", cfb->fat[sect]);
+#endif		
+	return cfb->fat[sect];
+#else
+/*
+ * If Header Major Version is 3, there MUST be 128 fields
+ * specified to fill a 512-byte sector.  If Header Major
+ * Version is 4, there MUST be 1,024 fields specified to
+ * fill a 4,096-byte sector.
+ */	
+	DWORD shift = cfb->header._uSectorShift; // sector size is 1 << shift
+	FSINDEX SECTn = (FSINDEX)1 << (shift - 2); // number of sectors in FAT
+
+/* The DIFAT sectors are linked together by the last field
+ * in each DIFAT sector. As an optimization, the first 109
+ * FAT sectors are represented within the header itself.  No
+ * DIFAT sectors are needed in a compound file that is
+ * smaller than 6.875 megabytes (MB) for a 512-byte sector
+ * compound file (6.875 MB = (1 header sector + 109 FAT
+ * sectors x 128 non-empty entries) × 512 bytes per sector).
+ * Locations of all FAT sectors (from header and DIFAT) are
+ * resolved once in _cfb_init.
+ */ 
+	FSINDEX FAT_INDEX = sect >> (shift - 2);
+	FSINDEX SECT_INDEX = sect & (SECTn - 1);
+	if (FAT_INDEX >= cfb->difatn)
+		return ENDOFCHAIN;
+
 	// get SECT offset
-	DWORD off = mFAT * ssize + ssize + (SECT_INDEX * 4);
-	// seek to offset
-	fseek(cfb->fp, off, SEEK_SET);
+	SECT FAT = cfb->difat[FAT_INDEX];
+	off_t off = (((off_t)FAT + 1) << shift) + SECT_INDEX * 4;
+
+	// read sect
 	SECT ch;
-	if (fread(&ch, 4, 1, cfb->fp) != 1){
+	if (_cfb_read(cfb, off, &ch, 4))
+		return ENDOFCHAIN;
+	if (cfb->biteOrder) 
+		ch = bswap_32(ch);		
+
+#ifdef DEBUG
+	LOG("0x%x", ch);
+#endif		
+	return ch;	
+#endif // CFB_NO_FAT_CACHE
+}
+
+static SECT _cfb_next_sect_in_mFAT_chain(SECT sect, struct cfb * cfb){
+/*
+ *  The mini FAT is used to allocate space in the mini
+ *  stream. The mini stream is divided into smaller,
+ *  equal-length sectors, and the sector size that is used
+ *  for the mini stream is specified from the Compound File
+ *  Header (64 bytes).
+ */	
+
 #ifdef DEBUG
-	LOG("Error to read SECT from offset: %u", off);
+	LOG("get next SECT in mFAT chain for: 0x%x:\t", sect);
 #endif		
+	_CFB_STAT_INC(cfb, mfat_lookups);
+
+	if (sect > MAXSECT)
+		return ENDOFCHAIN;	
+
+#ifndef CFB_NO_FAT_CACHE
+	// miniFAT is loaded to memory in _cfb_init
+	if (sect >= cfb->mfatn)
+		return ENDOFCHAIN;
+#ifdef DEBUG
+	LOG("0x%x", cfb->mfat[sect]);
+#endif		
+	return cfb->mfat[sect];
+#else
+/*
+ * The mini stream is chained within the FAT in exactly the
+ * same fashion as any normal stream.  The mini stream's
+ * starting sector is referenced in the first directory
+ * entry (root storage stream ID 0).
+ */	
+	DWORD shift = cfb->header._uSectorShift; // sector size - for mFAT it is 512(4096)
+	FSINDEX SECTn = (FSINDEX)1 << (shift - 2); // number of sectors in mFAT
+	
+	FSINDEX mFAT_INDEX = sect >> (shift - 2);
+	FSINDEX SECT_INDEX = sect & (SECTn - 1);
+
+	// locations of miniFAT sectors are resolved in _cfb_init
+	if (mFAT_INDEX >= cfb->mfatsectn)
+		return ENDOFCHAIN;
+	SECT mFAT = cfb->mfatsect[mFAT_INDEX];
+	
+	// get SECT offset
+	off_t off = (((off_t)mFAT + 1) << shift) + (SECT_INDEX * 4);
+	SECT ch;
+	if (_cfb_read(cfb, off, &ch, 4))
 		return ENDOFCHAIN;
-	};
 	if (cfb->biteOrder) 
 		ch = bswap_32(ch);
 #ifdef DEBUG
 	LOG("0x%x", ch);
 #endif		
 	return ch;	
+#endif // CFB_NO_FAT_CACHE
+}
+
+// return number of WORDs of directory entry name (without
+// terminating null) and decode name to utf16
+static int _cfb_dir_name16(cfb_dir * dir, WORD name[32]){
+	int i, len = dir->_cb / 2;
+	if (len > 32)
+		len = 32;
+	for (i = 0; i < len; ++i)
+		name[i] = dir->_ab[2*i] | (dir->_ab[2*i + 1] << 8);
+	while (len > 0 && name[len - 1] == 0)
+		len--;
+	return len;
+}
+
+// decode directory entry name to utf8 - name must have
+// space for 97 bytes
+static int cfb_dir_name(cfb_dir * dir, char * name){
+	WORD ab[32];
+	int len = _cfb_dir_name16(dir, ab);
+	_utf16_to_utf8(ab, len, name);
+	return len ? 0 : -1;
+}
+
+static int _cfb_stream_open(struct cfb * cfb, cfb_dir * dir, 
+		cfb_stream * stream, void ** buf, size_t * cap);
+
+/*
+ * The mini stream is chained within the FAT in exactly the
+ * same fashion as any normal stream. The mini stream's
+ * starting sector is referenced in the first directory
+ * entry (root storage stream ID 0).
+ * Ministream is opened as FAT stream on first access to
+ * stream in miniFAT - data is not copied.
+ */
+static int _cfb_ministream(struct cfb * cfb){
+#ifndef CFB_NO_THREADS
+	if (__atomic_load_n(&cfb->mstream_ready, __ATOMIC_ACQUIRE))
+		return 0;
+	pthread_mutex_lock(&cfb->lock);
+#endif
+	int error = 0;
+	if (!cfb->mstream_ready){
+#ifdef DEBUG
+	LOG("open mini stream");
+#endif
+		_CFB_STAT_START(t);
+		cfb_stream stream;
+		if (cfb->header._csectMiniFat == 0)
+			error = CFB_MFAT_ERR;
+		else 
+			error = _cfb_stream_open(cfb, &cfb->root, &stream, 
+					(void **)&cfb->msects, &cfb->msectscap);
+		if (!error){
+			cfb->mstream = stream;
+#ifndef CFB_NO_THREADS
+			__atomic_store_n(&cfb->mstream_ready, true, __ATOMIC_RELEASE);
+#else
+			cfb->mstream_ready = true;
+#endif
+		}
+		_CFB_STAT_TIME(cfb, ns_mstream, t);
+	}
+#ifndef CFB_NO_THREADS
+	pthread_mutex_unlock(&cfb->lock);
+#endif
+	return error;
+}
+
+static const struct _cfb_geometry * _cfb_geometry_get(DWORD shift);
+
+/*
+ * Open stream of directory entry - chain of stream is
+ * resolved to sector list allocated with allocator of cfb,
+ * or to buffer *buf of capacity *cap (grown if needed) of cfb
+ * if buf is not NULL
+ */
+static int _cfb_stream_open(struct cfb * cfb, cfb_dir * dir, 
+		cfb_stream * stream, void ** buf, size_t * cap)
+{
+#ifdef DEBUG
+	char dirname[BUFSIZ];
+	cfb_dir_name(dir, dirname);	
+	LOG("dirname: %s", dirname);
+#endif
+	FSINDEX i;
+#ifdef CFB_NO_FAT_CACHE
+	SECT (*get_next_sect)(SECT sect, struct cfb * cfb); // get next sect function
+#endif
+
+	memset(stream, 0, sizeof(cfb_stream));
+	stream->cfb = cfb;
+	stream->dir = *dir;
+	stream->geom = _cfb_geometry_get(0);
+
+	//check FAT or miniFAT
+	//use miniFAT is size < 4096
+	//for root always use FAT
+	if (dir->_ulSize < cfb->header._ulMiniSectorCutoff && dir->_mse != STGTY_ROOT){
+#ifdef DEBUG
+	LOG("stream is minifat");
+#endif		
+		if (dir->_ulSize > 0 && _cfb_ministream(cfb))
+			return CFB_MFAT_ERR;
+		stream->mini = true;
+		stream->shift = cfb->header._uMiniSectorShift;
+#ifdef CFB_NO_FAT_CACHE
+		get_next_sect = _cfb_next_sect_in_mFAT_chain;
+#endif
+	} else {
+#ifdef DEBUG
+	LOG("stream is fat");
+#endif				
+		stream->shift = cfb->header._uSectorShift;
+#ifdef CFB_NO_FAT_CACHE
+		get_next_sect = _cfb_next_sect_in_FAT_chain;
+#endif
+	}
+	stream->ssize = (DWORD)1 << stream->shift;
+	stream->geom = _cfb_geometry_get(stream->shift);
+
+	// chain can't be longer then stream size
+	FSINDEX n = dir->_ulSize / stream->ssize 
+		+ (dir->_ulSize % stream->ssize ? 1 : 0);
+	if (n == 0)
+		return 0;
+
+	// sector list is in index
+	if (cfb->index_chain){
+		FSINDEX k;
+		const SECT * sects = cfb->index_chain(cfb->index, dir, stream->mini, &k);
+		if (sects){
+			stream->sects = (SECT *)sects;
+			stream->sectn = k < n ? k : n;
+			stream->borrowed = true;
+			return 0;
+		}
+	}
+	
+	if (buf){
+		stream->sects = (SECT *)_cfb_buf(cfb, buf, cap, (size_t)n * sizeof(SECT));
+		stream->borrowed = true;
+	} else
+		stream->sects = (SECT *)_cfb_alloc(cfb, (size_t)n * sizeof(SECT));
+	if (!stream->sects){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+
+	SECT sect = dir->_sectStart;
+#ifndef CFB_NO_FAT_CACHE
+	// tables are validated at open - all values are in table
+	// or ENDOFCHAIN
+	const SECT * table = stream->mini ? cfb->mfat : cfb->fat;
+	FSINDEX tablen = stream->mini ? cfb->mfatn : cfb->fatn;
+	for (i = 0; i < n && sect < tablen; ++i) {
+		stream->sects[i] = sect;
+		sect = table[sect];
+	}
+#else
+	for (i = 0; i < n && sect <= MAXSECT; ++i) {
+		stream->sects[i] = sect;
+		sect = get_next_sect(sect, cfb);
+	}
+#endif
+	stream->sectn = i;
+
+#ifdef DEBUG
+	LOG("stream size: %u, sectors: %u", dir->_ulSize, stream->sectn);
+#endif
+	return 0;
+}
+
+// return size of stream data in bytes
+static ULONG cfb_stream_size(cfb_stream * stream){
+	ULONG size = stream->dir._ulSize;
+	// stream is shorter if sector chain is broken
+	if ((uint64_t)stream->sectn * stream->ssize < size)
+		size = stream->sectn * stream->ssize;
+	return size;
+}
+
+/*
+ * Geometry
+ * Routines that map stream offsets to sectors are written
+ * once as inline functions of sector shift and are
+ * instantiated for mini sectors (64), v3 (512) and v4 (4096)
+ * sectors, so shifts and masks are constants. Table of
+ * routines is chosen in cfb_stream_open, other shifts use
+ * instance with shift of stream.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define _CFB_INLINE static inline __attribute__((always_inline))
+#else
+#define _CFB_INLINE static inline
+#endif
+
+struct _cfb_plan;
+
+struct _cfb_geometry {
+	size_t (*run)(cfb_stream * stream, ULONG offset, size_t len);
+	size_t (*plan)(cfb_stream * stream, ULONG offset, size_t len, 
+			struct _cfb_plan * plan);
+	ssize_t (*read)(cfb_stream * stream, ULONG offset, void * buf, size_t len);
+	const uint8_t * (*map)(cfb_stream * stream, ULONG offset, size_t * len);
+};
+
+/*
+ * Return number of bytes of stream at offset (not more then
+ * len) stored in one run of contiguous sectors. Office
+ * writers usually put stream to contiguous sectors, so data
+ * is read with one large read for each run.
+ */
+_CFB_INLINE size_t _cfb_stream_run_g(cfb_stream * stream, ULONG offset, 
+		size_t len, const DWORD shift)
+{
+	const DWORD ssize = (DWORD)1 << shift;
+	FSINDEX index = offset >> shift;
+	size_t n = ssize - (offset & (ssize - 1));
+	while (n < len && index + 1 < stream->sectn &&
+			stream->sects[index + 1] == stream->sects[index] + 1)
+	{
+		n += ssize;
+		index++;
+	}
+	return n < len ? n : len;
+}
+
+static size_t _cfb_stream_run(cfb_stream * stream, ULONG offset, size_t len){
+	return stream->geom->run(stream, offset, len);
+}
+
+/*
+ * Readahead
+ * Sector chain of stream is known at open, so reads can be
+ * planned before data is needed: runs of sectors (of
+ * ministream for mini streams) are coalesced to extents of
+ * file and passed to readahead of backend, so reads of
+ * fragmented streams overlap instead of waiting for each
+ * sector.
+ */
+struct _cfb_plan {
+	struct cfb_extent * ext;
+	size_t n;     // max number of extents
+	size_t count; // number of extents
+};
+
+// add extent to plan (merged with last if adjacent), return
+// false if plan is full
+static bool _cfb_plan_add(struct _cfb_plan * plan, off_t off, size_t len){
+	if (plan->count > 0){
+		struct cfb_extent * last = &plan->ext[plan->count - 1];
+		if (last->off + (off_t)last->len == off){
+			last->len += len;
+			return true;
+		}
+	}
+	if (plan->count == plan->n)
+		return false;
+	plan->ext[plan->count].off = off;
+	plan->ext[plan->count].len = len;
+	plan->count++;
+	return true;
+}
+
+static size_t _cfb_plan_stream(cfb_stream * stream, ULONG offset, size_t len, 
+		struct _cfb_plan * plan)
+{
+	return stream->geom->plan(stream, offset, len, plan);
+}
+
+// add extents of len bytes of stream from offset to plan,
+// return number of bytes of stream added
+_CFB_INLINE size_t _cfb_plan_stream_g(cfb_stream * stream, ULONG offset, 
+		size_t len, struct _cfb_plan * plan, const DWORD shift)
+{
+	const DWORD ssize = (DWORD)1 << shift;
+	ULONG size = cfb_stream_size(stream);
+	if (offset >= size)
+		return 0;
+	if (len > size - offset)
+		len = size - offset;
+
+	size_t done = 0;
+	while (done < len) {
+		FSINDEX index = offset >> shift;
+		DWORD   off   = offset & (ssize - 1);
+		SECT    sect  = stream->sects[index];
+		size_t n = _cfb_stream_run_g(stream, offset, len - done, shift);
+		if (stream->mini){
+			// run of mini sectors is a range of ministream
+			size_t k = _cfb_plan_stream(&stream->cfb->mstream, 
+					(sect << shift) + off, n, plan);
+			done += k;
+			if (k < n)
+				break;
+		} else {
+			if (!_cfb_plan_add(plan, 
+					(((off_t)sect + 1) << shift) + off, n))
+				break;
+			done += n;
+		}
+		offset += n;
+	}
+	return done;
+}
+
+/*
+ * function `cfb_stream_plan`
+ * Plan read of len bytes of stream from offset: runs of
+ * sectors are coalesced to extents of file. Not more then *n
+ * extents are set to ext, and *n is set to number of
+ * extents. Return number of bytes of stream covered by plan
+ * (less then len if plan is full or at end of stream)
+ */
+static size_t cfb_stream_plan(cfb_stream * stream, ULONG offset, size_t len, 
+		struct cfb_extent * ext, size_t * n)
+{
+	struct _cfb_plan plan = {ext, *n, 0};
+	size_t done = _cfb_plan_stream(stream, offset, len, &plan);
+	*n = plan.count;
+	return done;
+}
+
+/*
+ * function `cfb_stream_readahead`
+ * Tell backend that len bytes of stream from offset will be
+ * read soon - extents of plan are passed to readahead of
+ * backend (posix_fadvise for files, madvise for mmap). Does
+ * nothing if backend has no readahead
+ */
+static void cfb_stream_readahead(cfb_stream * stream, ULONG offset, size_t len){
+	struct cfb * cfb = stream->cfb;
+	if (!cfb->io.readahead)
+		return;
+
+	struct cfb_extent ext[CFB_IOVEC_MAX];
+	while (len > 0) {
+		size_t n = CFB_IOVEC_MAX;
+		size_t k = cfb_stream_plan(stream, offset, len, ext, &n);
+		if (n > 0)
+			cfb->io.readahead(cfb->io.ctx, ext, n);
+		if (k == 0)
+			break;
+		offset += k;
+		len -= k;
+	}
 }
 
-static int cfb_dir_name(cfb_dir * dir, char * name){
-	int size = dir->_cb/2;
-	WORD ab[size];
-	int i, c;
-	for (i = 0, c = 0; i < dir->_cb; ++i, ++c) {
-		char ch0 = dir->_ab[i++];	
-		char ch1 = dir->_ab[i];	
-		if (ch1 == 0)
-			ab[c] = ch0;
-		else
-			ab[c] = (ch0 << 8) + ch1;
-	}
+/*
+ * Read len bytes of stream data from offset to buf. Return
+ * number of bytes read - less then len at end of stream, or
+ * -1 on error. Runs of contiguous sectors are read with one
+ * read, and reads are batched for backend
+ */
+static ssize_t cfb_stream_read(cfb_stream * stream, ULONG offset, 
+		void * buf, size_t len)
+{
+	return stream->geom->read(stream, offset, buf, len);
+}
 
-	if (!_utf16_to_utf8(ab, dir->_cb, name))
+_CFB_INLINE ssize_t _cfb_stream_read_g(cfb_stream * stream, ULONG offset, 
+		void * buf, size_t len, const DWORD shift)
+{
+	const DWORD ssize = (DWORD)1 << shift;
+	struct cfb * cfb = stream->cfb;
+	ULONG size = cfb_stream_size(stream);
+	if (offset >= size)
+		return 0;
+	if (len > size - offset)
+		len = size - offset;
+
+	struct cfb_iovec vec[CFB_IOVEC_MAX];
+	int nvec = 0;
+	bool ahead = false; // rest of data is read ahead
+	size_t done = 0;
+	while (done < len) {
+		FSINDEX index = offset >> shift;
+		DWORD   off   = offset & (ssize - 1);
+		SECT    sect  = stream->sects[index];
+		size_t n = _cfb_stream_run_g(stream, offset, len - done, shift);
+		if (stream->mini){
+			// mini sectors are read from ministream
+			ULONG p = (sect << shift) + off;
+			if (cfb_stream_read(&cfb->mstream, p, (char *)buf + done, n) 
+					!= (ssize_t)n)
+			{
+				ERR("can't read stream sector: 0x%x", sect);
+				return -1;
+			}
+		} else {
+			vec[nvec].off = (((off_t)sect + 1) << shift) + off;
+			vec[nvec].buf = (char *)buf + done;
+			vec[nvec].len = n;
+			if (++nvec == CFB_IOVEC_MAX){
+				// more then one batch - read rest ahead while
+				// this batch is read
+				if (!ahead){
+					cfb_stream_readahead(stream, offset + n, len - done - n);
+					ahead = true;
+				}
+				if (_cfb_read_vec(cfb, vec, nvec)){
+					ERR("can't read stream sector: 0x%x", sect);
+					return -1;
+				}
+				nvec = 0;
+			}
+		}
+		done += n;
+		offset += n;
+	}
+	if (_cfb_read_vec(cfb, vec, nvec)){
+		ERR("can't read stream");
 		return -1;
-
-	return 0;
+	}
+	return done;
 }
 
-static FILE * cfb_get_stream_by_dir(struct cfb * cfb, cfb_dir * dir) {
-#ifdef DEBUG
-	char dirname[BUFSIZ];
-	cfb_dir_name(dir, dirname);	
-	LOG("dirname: %s", dirname);
-#endif
-
-	ULONG st = dir->_ulSize;    //size of stream
+/*
+ * Return pointer to stream data at offset without copy - if
+ * file is mapped to memory. len is number of bytes wanted
+ * and is set to number of bytes available in one contiguous
+ * run of sectors (may be less then wanted). Return NULL if
+ * file is not mapped or offset is out of stream.
+ */
+static const uint8_t * cfb_stream_map(cfb_stream * stream, ULONG offset, 
+		size_t * len)
+{
+	return stream->geom->map(stream, offset, len);
+}
 
-#ifdef DEBUG
-	LOG("stream size: %u", st);
-#endif
-	SECT  sect = dir->_sectStart; // start position in FAT/miniFAT chain
-#ifdef DEBUG
-	LOG("stream start sector: 0x%x", dir->_sectStart);
-#endif
+_CFB_INLINE const uint8_t * _cfb_stream_map_g(cfb_stream * stream, 
+		ULONG offset, size_t * len, const DWORD shift)
+{
+	const DWORD ssize = (DWORD)1 << shift;
+	struct cfb * cfb = stream->cfb;
+	ULONG size = cfb_stream_size(stream);
+	if (!cfb->io.data || offset >= size){
+		*len = 0;
+		return NULL;
+	}
+	if (*len > size - offset)
+		*len = size - offset;
+
+	FSINDEX index = offset >> shift;
+	DWORD   off   = offset & (ssize - 1);
+	*len = _cfb_stream_run_g(stream, offset, *len, shift);
+	if (stream->mini){
+		// mini sectors are mapped in ministream
+		ULONG p = (stream->sects[index] << shift) + off;
+		return cfb_stream_map(&cfb->mstream, p, len);
+	}
 
-	DWORD ssize;  //sector size	
-	DWORD sstart; //start for sectors - 0 for mFAT, ssize for FAT; 
-	FILE * fp;    // file pointer - ministream for mFAT, main stream for FAT
-	SECT (*get_next_sect)(SECT sect, struct cfb * cfb); // get next sect function
+	off_t p = (((off_t)stream->sects[index] + 1) << shift) + off;
 	
-	//check FAT or miniFAT
-	//use miniFAT is size < 4096
-	//for root always use FAT
-	if (st < cfb->header._ulMiniSectorCutoff && dir->_mse != STGTY_ROOT){
-#ifdef DEBUG
-	LOG("stream is minifat");
-#endif		
-		//use miniFAT
-		ssize = 1 << cfb->header._uMiniSectorShift;
-		sstart = 0;
-		fp = cfb->ministream;
-		get_next_sect = _cfb_next_sect_in_mFAT_chain;
+	if ((size_t)p > cfb->io.size || *len > cfb->io.size - p){
+		*len = 0;
+		return NULL;
 	}
-	else {
-#ifdef DEBUG
-	LOG("stream is fat");
-#endif				
-		//use FAT
-		ssize = 1 << cfb->header._uSectorShift;
-		sstart = ssize;
-		fp = cfb->fp;
-		get_next_sect = _cfb_next_sect_in_FAT_chain;
-	} 
-	
-	DWORD off = sect * ssize + sstart; //offset
-	
-#ifdef DEBUG
-	LOG("sectorsize: %d", ssize);
-	LOG("offset: %d"    , off  );
-#endif				
-	
-	//create stream
-	FILE * stream = tmpfile();
+	return cfb->io.data + p;
+}
 
-	//copy data
-	while (sect != ENDOFCHAIN) {
-		// seek to start offset
-		fseek(fp, off, SEEK_SET);
+// instance of geometry routines for shift - shift may be
+// expression of argument stream
+#define _CFB_GEOMETRY(name, shift) \
+static size_t _cfb_stream_run_##name(cfb_stream * stream, ULONG offset, \
+		size_t len) \
+{ return _cfb_stream_run_g(stream, offset, len, (shift)); } \
+static size_t _cfb_plan_stream_##name(cfb_stream * stream, ULONG offset, \
+		size_t len, struct _cfb_plan * plan) \
+{ return _cfb_plan_stream_g(stream, offset, len, plan, (shift)); } \
+static ssize_t _cfb_stream_read_##name(cfb_stream * stream, ULONG offset, \
+		void * buf, size_t len) \
+{ return _cfb_stream_read_g(stream, offset, buf, len, (shift)); } \
+static const uint8_t * _cfb_stream_map_##name(cfb_stream * stream, \
+		ULONG offset, size_t * len) \
+{ return _cfb_stream_map_g(stream, offset, len, (shift)); } \
+static const struct _cfb_geometry _cfb_geometry_##name = { \
+	_cfb_stream_run_##name, _cfb_plan_stream_##name, \
+	_cfb_stream_read_##name, _cfb_stream_map_##name };
+
+_CFB_GEOMETRY(6,   6)
+_CFB_GEOMETRY(9,   9)
+_CFB_GEOMETRY(12,  12)
+_CFB_GEOMETRY(any, stream->shift)
+
+static const struct _cfb_geometry * _cfb_geometry_get(DWORD shift){
+	switch (shift) {
+		case 6:  return &_cfb_geometry_6;
+		case 9:  return &_cfb_geometry_9;
+		case 12: return &_cfb_geometry_12;
+	}
+	return &_cfb_geometry_any;
+}
 
-		// read/write data
-		char buf[ssize];
-		if (fread (buf, ssize, 1,
-					fp) != 1)
-		{
-			ERR("fread");
-			return NULL;
+static int cfb_stream_open(struct cfb * cfb, cfb_dir * dir, cfb_stream * stream){
+	return _cfb_stream_open(cfb, dir, stream, NULL, NULL);
+}
+
+static void cfb_stream_close(cfb_stream * stream){
+	if (!stream->borrowed && stream->sects)
+		_cfb_free(stream->cfb, stream->sects);
+	stream->sects = NULL;
+	stream->sectn = 0;
+}
+
+/*
+ * Execute callback for each run of contiguous sectors of
+ * stream data from offset off to end. If file is not mapped
+ * run is read to buffer *buf of CFB_COPY_BUFSIZE bytes
+ * (allocated on first use, should be freed by caller).
+ * Return 0, -1 if stopped by callback or error code
+ */
+static int _cfb_stream_chunks(cfb_stream * stream, ULONG off, ULONG end, 
+		uint8_t ** buf, void * user_data,
+		int (*callback)(void * user_data, ULONG offset, 
+			const uint8_t * data, size_t len))
+{
+	ULONG ahead = off; // data before is read ahead
+	while (off < end) {
+		// keep CFB_READAHEAD bytes ahead of callback
+		if (ahead < off)
+			ahead = off;
+		if (ahead < end && ahead - off < CFB_READAHEAD){
+			size_t n = end - ahead < CFB_READAHEAD ? end - ahead : CFB_READAHEAD;
+			cfb_stream_readahead(stream, ahead, n);
+			ahead += n;
 		}
-		fwrite(buf, ssize, 1, stream );
-		
-		// get next FAT/miniFAT
-		sect = get_next_sect(sect, cfb);
+		size_t len = end - off;
+		const uint8_t * ptr = cfb_stream_map(stream, off, &len);
+		if (!ptr){
+			// not mapped - read to buffer
+			if (!*buf && !(*buf = (uint8_t *)_cfb_alloc(stream->cfb, 
+							CFB_COPY_BUFSIZE))){
+				ERR("malloc");
+				return CFB_ALLOC_ERR;
+			}
+			len = end - off < CFB_COPY_BUFSIZE ? end - off : CFB_COPY_BUFSIZE;
+			len = _cfb_stream_run(stream, off, len);
+			if (cfb_stream_read(stream, off, *buf, len) != (ssize_t)len)
+				return CFB_READ_ERR;
+			ptr = *buf;
+		}
+		if (callback(user_data, off, ptr, len))
+			return -1;
+		off += len;
+	}
+	return 0;
+}
+
+/*
+ * function `cfb_stream_foreach_chunk`
+ * Execute callback for each run of contiguous sectors of
+ * stream data (trimmed to stream size) - data is not
+ * buffered for mapped file, and only one buffer of
+ * CFB_COPY_BUFSIZE is used for stdio, so memory use does not
+ * depend on stream size. Return 0, -1 if stopped by callback
+ * (return non 0 in callback) or error code
+ */
+static int cfb_stream_foreach_chunk(struct cfb * cfb, cfb_dir * dir, 
+		void * user_data,
+		int (*callback)(void * user_data, ULONG offset, 
+			const uint8_t * data, size_t len))
+{
+	cfb_stream stream;
+	int error = cfb_stream_open(cfb, dir, &stream);
+	if (error)
+		return error;
+
+	uint8_t * buf = NULL;
+	error = _cfb_stream_chunks(&stream, 0, cfb_stream_size(&stream), 
+			&buf, user_data, callback);
+	_cfb_free(cfb, buf);
+	cfb_stream_close(&stream);
+	return error;
+}
 
-		// get next offset 
-		off = sect * ssize + sstart;
+static int _cfb_fwrite_callback(void * user_data, ULONG offset, 
+		const uint8_t * data, size_t len)
+{
+	(void)offset; // chunks come in order of stream
+	if (fwrite(data, len, 1, (FILE *)user_data) != 1){
+		ERR("fwrite");
+		return 1;
+	}
+	return 0;
+}
+
+static FILE * cfb_get_stream_by_dir(struct cfb * cfb, cfb_dir * dir) {
+	//create stream
+	FILE * fp = tmpfile();
+	if (!fp){
+		ERR("tmpfile");
+		return NULL;
 	}
 
-	fseek(stream, 0, SEEK_SET);
-	return stream;	
+	//copy data - one write for each run of contiguous sectors
+	if (cfb_stream_foreach_chunk(cfb, dir, fp, _cfb_fwrite_callback)){
+		fclose(fp);
+		return NULL;
+	}
+
+	fseek(fp, 0, SEEK_SET);
+	return fp;	
 }
 
 static int cfb_dir_by_sid(struct cfb * cfb, SID sid, void * user_data,
 		int (*callback)(void * user_data, cfb_dir dir))
 {
-	int i;
-	
-	//goto dir data
-	ULONG p = 
-		512 
-		+ sid*sizeof(cfb_dir) 
-		+ (cfb->header._sectDirStart << cfb->header._uSectorShift);
-	fseek(cfb->fp, p, SEEK_SET);
-
-	//copy dir data
-	cfb_dir dir;
-
-	if (fread(&dir, sizeof(cfb_dir), 1, cfb->fp) != 1)
+	// directory is loaded to memory in _cfb_init
+	if (sid >= cfb->dirn)
 		return -1;
-
-	if (cfb->biteOrder)
-		_cfb_dir_sw(&dir);
 	
+	_CFB_STAT_INC(cfb, dir_reads);
 	if (callback)
-		callback(user_data, dir);
+		callback(user_data, cfb->dirs[sid]);
 
 	return 0;
 }
@@ -838,49 +2163,86 @@ static int cfb_get_dir_by_sid(struct cfb * cfb, cfb_dir * dir, SID sid){
 	return cfb_dir_by_sid(cfb, sid, dir, cfb_dir_callback);
 }
 
-static int _cfb_dir_find(struct cfb *cfb, cfb_dir * dir, const char * name, void * user_data,
-		int (*callback)(void * user_data, cfb_dir dir))
-{
-#ifdef DEBUG
-	LOG("name: %s", name);
-#endif		
-	
-	if(!dir)
-		return -1;
-	//check name
-	char dirname[BUFSIZ]; 
-	if (cfb_dir_name(dir, dirname))
-		return -1;
-	int res;
-	size_t name_len = strlen(name);
-	size_t dirname_len = strlen(dirname);
-	if (name_len < dirname_len)
-		res = -1;
-	else if (name_len > dirname_len)
-		res = 1;
-	else 
-		res = strcmp(name, dirname);
-	if (res == 0)
-		callback(user_data, *dir);
-	if (res < 0){
-		//check left
-		if (dir->_sidLeftSib != -1){
-			cfb_dir new_dir;
-			cfb_dir_by_sid(cfb, dir->_sidLeftSib, &new_dir, cfb_dir_callback);
-
-			return _cfb_dir_find(cfb, &new_dir, name, user_data, callback);
-		}
-	} else {
-		//check right
-		if (dir->_sidRightSib != -1){
+/*
+ * Names of directory entries are compared case-insensitive:
+ * shorter name is less, names of equal length are compared
+ * by uppercased UTF-16 code points. [MS-CFB] uses simple
+ * case folding of the Unicode table; the ranges below cover
+ * Latin-1, Latin Extended-A, Greek and Cyrillic
+ */
+static WORD _cfb_upper(WORD c){
+	if (c < 0x80)
+		return (c >= 'a' && c <= 'z') ? c - 0x20 : c;
+	if (c >= 0xE0 && c <= 0xFE && c != 0xF7)
+		return c - 0x20;
+	if (c == 0xFF)
+		return 0x178;
+	if (c >= 0x100 && c <= 0x17F) {
+		if ((c <= 0x137 || (c >= 0x14A && c <= 0x177)) && (c & 1))
+			return c - 1;
+		if (((c >= 0x139 && c <= 0x148) || (c >= 0x179 && c <= 0x17E)) && !(c & 1))
+			return c - 1;
+		return c;
+	}
+	if (c >= 0x3B1 && c <= 0x3CB)
+		return c == 0x3C2 ? 0x3A3 : c - 0x20;
+	if (c >= 0x430 && c <= 0x44F)
+		return c - 0x20;
+	if (c >= 0x450 && c <= 0x45F)
+		return c - 0x50;
+	return c;
+}
 
-			cfb_dir new_dir;
-			cfb_dir_by_sid(cfb, dir->_sidRightSib, &new_dir, cfb_dir_callback);
-			return _cfb_dir_find(cfb, &new_dir, name, user_data, callback);
-		}	
+// compare directory entry name (read from _ab as UTF-16LE)
+// with utf16 name in CFB order - return <0, 0 or >0
+static int _cfb_dir_namecmp(const cfb_dir * dir, const WORD * name, int len){
+	int i, dirlen = dir->_cb / 2;
+	if (dirlen > 32)
+		dirlen = 32;
+	while (dirlen > 0 && 
+			!(dir->_ab[2*dirlen - 2] | dir->_ab[2*dirlen - 1]))
+		dirlen--;
+	if (dirlen != len)
+		return dirlen - len;
+	for (i = 0; i < len; ++i) {
+		WORD a = _cfb_upper(dir->_ab[2*i] | (dir->_ab[2*i + 1] << 8));
+		WORD b = _cfb_upper(name[i]);
+		if (a != b)
+			return a - b;
 	}
 	return 0;
 }
+
+// FNV-1a hash of storage SID and uppercased name of
+// directory entry
+static ULONG _cfb_dir_hash(SID parent, const WORD * name, int len){
+	int i;
+	ULONG h = 2166136261u;
+	h = (h ^ parent) * 16777619u;
+	for (i = 0; i < len; ++i) {
+		WORD c = _cfb_upper(name[i]);
+		h = (h ^ (c & 0xFF)) * 16777619u;
+		h = (h ^ (c >> 8))   * 16777619u;
+	}
+	return h;
+}
+
+// return SID of entry with name in storage parent or NOSTREAM
+static SID _cfb_dir_lookup(struct cfb * cfb, SID parent, const WORD * name, int len){
+	if (!cfb->dirhashn)
+		return NOSTREAM;
+	ULONG mask = cfb->dirhashn - 1;
+	ULONG h = _cfb_dir_hash(parent, name, len) & mask;
+	while (cfb->dirhash[h].sid != NOSTREAM) {
+		struct cfb_dirhash * e = &cfb->dirhash[h];
+		if (e->parent == parent && 
+				_cfb_dir_namecmp(&cfb->dirs[e->sid], name, len) == 0)
+			return e->sid;
+		h = (h + 1) & mask;
+	}
+	return NOSTREAM;
+}
+
 static int cfb_dir_by_name(struct cfb * cfb, const char * name, void * user_data,
 		int (*callback)(void * user_data, cfb_dir dir))
 {
@@ -888,9 +2250,17 @@ static int cfb_dir_by_name(struct cfb * cfb, const char * name, void * user_data
 	LOG("name: %s", name);
 #endif		
 	
-	cfb_dir dir;
-	cfb_get_dir_by_sid(cfb, &dir, cfb->root._sidChild);
-	return _cfb_dir_find(cfb, &dir, name, user_data, callback);
+	WORD name16[32];
+	int len = _utf8_to_utf16(name, 32, name16);
+	if (len < 0)
+		return -1;
+	
+	// streams of root storage
+	SID sid = _cfb_dir_lookup(cfb, 0, name16, len);
+	if (sid == NOSTREAM)
+		return -1;
+	
+	return cfb_dir_by_sid(cfb, sid, user_data, callback);
 }
 
 static int cfb_get_dir_by_name(struct cfb * cfb, cfb_dir * dir, const char * name){
@@ -932,26 +2302,481 @@ static FILE * cfb_get_stream_by_name(struct cfb * cfb, const char * name) {
 			cfb_dir *:   cfb_get_stream_by_dir \
 	)((cfb), (arg))	
 
-static int _cfb_init(struct cfb * cfb, FILE *fp){
+/* DIFAT
+ * double-indirect file allocation table (DIFAT): A
+ * structure that is used to locate FAT sectors in a
+ * compound file.
+ *
+ *		FAT Sector Location (variable): This field specifies
+ *		the FAT sector number in a DIFAT.  If Header Major
+ *		Version is 3, there MUST be 127 fields specified to
+ *		fill a 512-byte sector minus the "Next DIFAT Sector
+ *		Location" field.  If Header Major Version is 4, there
+ *		MUST be 1,023 fields specified to fill a 4,096-byte
+ *		sector minus the "Next DIFAT Sector Location" field.
+ *
+ * Locations of all FAT sectors - 109 from header and others
+ * from DIFAT chain are resolved once at open to SECT array.
+*/	
+static int _cfb_load_difat(struct cfb * cfb){
+#ifdef DEBUG
+	LOG("start");
+#endif
+	FSINDEX i, k;
+
+	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size
+	FSINDEX SECTn = ssize/4; // number of SECTs in sector
+	FSINDEX FATn = SECTn - 1; // number of FAT sectors in DIFAT sector 
+	FSINDEX nfat = cfb->header._csectFat; // number of FAT sectors
+
+	if (nfat == 0 || nfat > MAXSECT / SECTn){
+#ifdef DEBUG
+	LOG("wrong number of FAT sectors: %u", nfat);
+#endif		
+		return CFB_FAT_ERR;
+	}
+
+	// FAT sectors (and FAT entries) must be in file if its
+	// size is known, so FAT of hostile header is not allocated
+	if (cfb->io.size && nfat > cfb->io.size >> cfb->header._uSectorShift){
+#ifdef DEBUG
+	LOG("number of FAT sectors is more then sectors in file: %u", nfat);
+#endif		
+		return CFB_FAT_ERR;
+	}
+
+	if (!_cfb_buf(cfb, (void **)&cfb->difat, &cfb->difatcap, 
+				(size_t)nfat * sizeof(SECT))){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	cfb->difatn = nfat;
+
+	// first 109 FAT sectors are in header
+	for (i = 0; i < nfat && i < 109; ++i) {
+		SECT FAT = cfb->header._sectFat[i];
+		if (cfb->biteOrder) 
+			FAT = bswap_32(FAT);		
+		cfb->difat[i] = FAT;
+	}
+
+	// other FAT sectors are in DIFAT chain - DIFAT sector is
+	// read to scratch buffer
+	SECT DIFAT = cfb->header._sectDifStart;
+	SECT * buf = NULL;
+	if (i < nfat && !(buf = (SECT *)_cfb_buf(cfb, &cfb->scratch, 
+					&cfb->scratchcap, ssize))){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	while (i < nfat) {
+		if (DIFAT > MAXSECT){
+#ifdef DEBUG
+	LOG("DIFAT chain is shorter then number of FAT sectors");
+#endif		
+			return CFB_DIF_ERR;
+		}
+		_CFB_STAT_INC(cfb, difat_hops);
+		if (_cfb_read(cfb, (off_t)DIFAT * ssize + ssize, buf, ssize))
+			return CFB_READ_ERR|CFB_DIF_ERR;
+		if (cfb->biteOrder)
+			bswap_32_array(buf, SECTn);
+
+		for (k = 0; k < FATn && i < nfat; ++k, ++i)
+			cfb->difat[i] = buf[k];
+		
+		// next DIFAT is in last field
+		DIFAT = buf[FATn];
+	}
+
+	return 0;
+}
+
+/*
+ * The FAT is loaded to memory once at open: all FAT sectors
+ * resolved from header and DIFAT are read to one SECT
+ * array, so next sector in chain is just an index in array.
+ */
+static int _cfb_load_fat(struct cfb * cfb){
+#ifdef DEBUG
+	LOG("start");
+#endif
+	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size
+	FSINDEX SECTn = ssize/4; // number of SECTs in FAT sector
+
+	if (!_cfb_buf(cfb, (void **)&cfb->fat, &cfb->fatcap, 
+				(size_t)cfb->difatn * ssize)){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	cfb->fatn = cfb->difatn * SECTn;
+
+	if (_cfb_read_sects(cfb, cfb->difat, cfb->difatn, cfb->fat))
+		return CFB_READ_ERR|CFB_FAT_ERR;
+
+	if (cfb->biteOrder)
+		bswap_32_array(cfb->fat, cfb->fatn);
+
+	return 0;
+}
+
+/*
+ * The miniFAT sectors are chained in the FAT. The chain is
+ * walked once at open to get locations of all miniFAT
+ * sectors, and miniFAT is loaded to memory.
+ */
+static int _cfb_load_mfat(struct cfb * cfb){
+#ifdef DEBUG
+	LOG("start");
+#endif
+	FSINDEX i;
+
+	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size
+	FSINDEX SECTn = ssize/4; // number of SECTs in miniFAT sector
+	FSINDEX nmfat = cfb->header._csectMiniFat; // number of miniFAT sectors
+
+	if (nmfat == 0)
+		return 0;
+	if (nmfat > MAXSECT / SECTn){
+#ifdef DEBUG
+	LOG("wrong number of miniFAT sectors: %u", nmfat);
+#endif		
+		return CFB_MFAT_ERR;
+	}
+
+	if (!_cfb_buf(cfb, (void **)&cfb->mfatsect, &cfb->mfatsectcap, 
+				(size_t)nmfat * sizeof(SECT))){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+
+	SECT sect = cfb->header._sectMiniFatStart;
+	for (i = 0; i < nmfat && sect <= MAXSECT; ++i) {
+		cfb->mfatsect[i] = sect;
+		sect = _cfb_next_sect_in_FAT_chain(sect, cfb);
+	}
+	// use the chain length if it is shorter then header value
+	cfb->mfatsectn = i;
+
+#ifndef CFB_NO_FAT_CACHE
+	if (cfb->mfatsectn == 0)
+		return 0;
+	if (!_cfb_buf(cfb, (void **)&cfb->mfat, &cfb->mfatcap, 
+				(size_t)cfb->mfatsectn * ssize)){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	cfb->mfatn = cfb->mfatsectn * SECTn;
+
+	if (_cfb_read_sects(cfb, cfb->mfatsect, cfb->mfatsectn, cfb->mfat))
+		return CFB_READ_ERR|CFB_MFAT_ERR;
+
+	if (cfb->biteOrder)
+		bswap_32_array(cfb->mfat, cfb->mfatn);
+#endif
+
+	return 0;
+}
+
+/*
+ * The directory is loaded to memory once at open: sectors
+ * of directory chain are read to one cfb_dir array, and
+ * index of entries by storage and name is built, so lookup
+ * by name does not need any I/O.
+ */
+static int _cfb_load_dirs(struct cfb * cfb){
+#ifdef DEBUG
+	LOG("start");
+#endif
+	SID i;
+
+	DWORD ssize = 1 << cfb->header._uSectorShift; //sector size
+
+	/* The directory is a standard chain of sectors in the FAT
+	 * and its sectors may be anywhere in file. Get number of
+	 * directory sectors - the chain is cut at sector out of
+	 * FAT or at sector already in chain (loop) */
+	FSINDEX n = 0, max = cfb->difatn * (ssize / 4);
+	uint8_t * seen = (uint8_t *)_cfb_buf(cfb, &cfb->scratch, &cfb->scratchcap, 
+			max / 8 + 1);
+	if (!seen){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	memset(seen, 0, max / 8 + 1);
+	SECT sect = cfb->header._sectDirStart;
+	while (sect < max && !(seen[sect / 8] & (1 << (sect % 8)))) {
+		seen[sect / 8] |= 1 << (sect % 8);
+		n++;
+		sect = _cfb_next_sect_in_FAT_chain(sect, cfb);
+	}
+#ifdef DEBUG
+	if (sect != ENDOFCHAIN)
+		LOG("directory chain is broken at sector: 0x%x", sect);
+#endif
+	if (n == 0 || (uint64_t)n * ssize > 0xFFFFFFFF)
+		return CFB_ROOT_ERR;
+
+	// read directory as stream of FAT sectors
+	cfb_dir dir;
+	memset(&dir, 0, sizeof(cfb_dir));
+	dir._mse = STGTY_ROOT;
+	dir._sectStart = cfb->header._sectDirStart;
+	dir._ulSize = n * ssize;
+
+	if (!_cfb_buf(cfb, (void **)&cfb->dirs, &cfb->dirscap, dir._ulSize)){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+
+	// sectors of directory are resolved to scratch buffer
+	cfb_stream stream;
+	int error = _cfb_stream_open(cfb, &dir, &stream, 
+			&cfb->scratch, &cfb->scratchcap);
+	if (error)
+		return error;
+	ssize_t len = cfb_stream_read(&stream, 0, cfb->dirs, dir._ulSize);
+	cfb_stream_close(&stream);
+	if (len != (ssize_t)dir._ulSize)
+		return CFB_READ_ERR|CFB_ROOT_ERR;
+
+	cfb->dirn = dir._ulSize / sizeof(cfb_dir);
+	if (cfb->biteOrder)
+		for (i = 0; i < cfb->dirn; ++i)
+			_cfb_dir_sw(&cfb->dirs[i]);
+
+	// build index - walk trees of all storages from root
+	cfb->dirhashn = 1;
+	while (cfb->dirhashn < cfb->dirn * 2)
+		cfb->dirhashn <<= 1;
+	_cfb_buf(cfb, (void **)&cfb->dirhash, &cfb->dirhashcap, 
+			cfb->dirhashn * sizeof(struct cfb_dirhash));
+	// stack of entries and bitmap of visited entries are in
+	// scratch buffer
+	struct cfb_dirhash * stack = (struct cfb_dirhash *)_cfb_buf(cfb, 
+			&cfb->scratch, &cfb->scratchcap, 
+			cfb->dirn * sizeof(struct cfb_dirhash) + cfb->dirn / 8 + 1);
+	if (!cfb->dirhash || !stack){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	uint8_t * visited = (uint8_t *)(stack + cfb->dirn);
+	memset(visited, 0, cfb->dirn / 8 + 1);
+	memset(cfb->dirhash, 0xFF, cfb->dirhashn * sizeof(struct cfb_dirhash));
+
+	SID top = 0;
+#define _CFB_DIR_PUSH(_sid, _parent) \
+	if ((_sid) < cfb->dirn && !(visited[(_sid) / 8] & (1 << ((_sid) % 8)))) { \
+		visited[(_sid) / 8] |= 1 << ((_sid) % 8); \
+		stack[top].sid = (_sid); stack[top].parent = (_parent); top++; \
+	}
+
+	visited[0] |= 1; // root
+	_CFB_DIR_PUSH(cfb->dirs[0]._sidChild, 0);
+	while (top > 0) {
+		struct cfb_dirhash e = stack[--top];
+		cfb_dir * d = &cfb->dirs[e.sid];
+		// skip links to unused entries
+		if (d->_mse == STGTY_INVALID)
+			continue;
+
+		WORD name[32];
+		int len = _cfb_dir_name16(d, name);
+		ULONG h = _cfb_dir_hash(e.parent, name, len) & (cfb->dirhashn - 1);
+		while (cfb->dirhash[h].sid != NOSTREAM)
+			h = (h + 1) & (cfb->dirhashn - 1);
+		cfb->dirhash[h] = e;
+
+		_CFB_DIR_PUSH(d->_sidLeftSib, e.parent);
+		_CFB_DIR_PUSH(d->_sidRightSib, e.parent);
+		if (d->_mse == STGTY_STORAGE)
+			_CFB_DIR_PUSH(d->_sidChild, e.sid);
+	}
+#undef _CFB_DIR_PUSH
+
+	return 0;
+}
+
+#ifndef CFB_NO_FAT_CACHE
+/*
+ * Validation
+ * Chains of cached FAT and miniFAT are checked once at open
+ * in one sweep with bitmap of visited sectors: values out of
+ * table (or file) are replaced with ENDOFCHAIN, chain is cut
+ * at sector already visited by this or other chain (loop or
+ * cross link) and is not followed more then size of stream.
+ * Streams with broken chains are truncated, so chains are
+ * walked at stream open with no checks but index in table.
+ */
+#define _CFB_SEEN(seen, sect)     (seen[(sect) / 8] & (1 << ((sect) % 8)))
+#define _CFB_SEEN_SET(seen, sect) (seen[(sect) / 8] |= 1 << ((sect) % 8))
+
+// walk chain of table of n sectors from start, not more then
+// max sectors, return number of sectors in chain
+static FSINDEX _cfb_validate_chain(SECT * table, FSINDEX n, uint8_t * seen,
+		SECT start, FSINDEX max)
+{
+	FSINDEX k = 0;
+	SECT sect = start, prev = ENDOFCHAIN;
+	while (k < max && sect < n) {
+		if (_CFB_SEEN(seen, sect)){
+			// loop or cross link - cut chain
+			if (prev != ENDOFCHAIN)
+				table[prev] = ENDOFCHAIN;
+			break;
+		}
+		_CFB_SEEN_SET(seen, sect);
+		k++;
+		prev = sect;
+		sect = table[sect];
+	}
+	return k;
+}
+
+// truncate stream dir to chain of k sectors of size ssize
+static void _cfb_validate_dir(struct cfb * cfb, cfb_dir * dir, FSINDEX k,
+		DWORD ssize)
+{
+	if ((uint64_t)k * ssize >= dir->_ulSize)
+		return;
+#ifdef DEBUG
+	LOG("chain of stream is broken - size %u truncated to %u", 
+			dir->_ulSize, k * ssize);
+#endif
+	cfb->damaged = true;
+	dir->_ulSize = k * ssize;
+	if (k == 0)
+		dir->_sectStart = ENDOFCHAIN;
+}
+
+static int _cfb_validate(struct cfb * cfb){
+	DWORD ssize = 1 << cfb->header._uSectorShift;
+	DWORD msize = 1 << cfb->header._uMiniSectorShift;
+	ULONG cutoff = cfb->header._ulMiniSectorCutoff;
+	FSINDEX i, n = cfb->fatn;
+	SID sid;
+
+	// sectors must start in file if its size is known
+	if (cfb->io.size){
+		uint64_t nfile = cfb->io.size / ssize;
+		nfile = nfile > 0 ? nfile - 1 : 0;
+		if (cfb->io.size % ssize)
+			nfile++;
+		if (nfile < n)
+			n = nfile;
+	}
+	for (i = 0; i < cfb->fatn; ++i)
+		if (cfb->fat[i] >= n && cfb->fat[i] <= MAXSECT)
+			cfb->fat[i] = ENDOFCHAIN;
+
+	uint8_t * seen = (uint8_t *)_cfb_buf(cfb, &cfb->scratch, 
+			&cfb->scratchcap, cfb->fatn / 8 + 1);
+	if (!seen){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	memset(seen, 0, cfb->fatn / 8 + 1);
+
+	// sectors of tables and directory are not data
+	for (i = 0; i < cfb->difatn; ++i)
+		if (cfb->difat[i] < n)
+			_CFB_SEEN_SET(seen, cfb->difat[i]);
+	for (i = 0; i < cfb->mfatsectn; ++i)
+		if (cfb->mfatsect[i] < n)
+			_CFB_SEEN_SET(seen, cfb->mfatsect[i]);
+	_cfb_validate_chain(cfb->fat, n, seen, cfb->header._sectDirStart, 
+			(cfb->dirn * sizeof(cfb_dir) + ssize - 1) / ssize);
+
+	// ministream is stream of root entry
+	cfb_dir * root = &cfb->dirs[0];
+	_cfb_validate_dir(cfb, root, 
+			_cfb_validate_chain(cfb->fat, n, seen, root->_sectStart,
+				((uint64_t)root->_ulSize + ssize - 1) / ssize), ssize);
+
+	for (sid = 1; sid < cfb->dirn; ++sid) {
+		cfb_dir * dir = &cfb->dirs[sid];
+		if (dir->_mse != STGTY_STREAM || dir->_ulSize < cutoff)
+			continue;
+		_cfb_validate_dir(cfb, dir, 
+				_cfb_validate_chain(cfb->fat, n, seen, dir->_sectStart,
+					((uint64_t)dir->_ulSize + ssize - 1) / ssize), ssize);
+	}
+
+	// mini sectors must be in ministream
+	FSINDEX mn = root->_ulSize / msize;
+	if (mn > cfb->mfatn)
+		mn = cfb->mfatn;
+	for (i = 0; i < cfb->mfatn; ++i)
+		if (cfb->mfat[i] >= mn && cfb->mfat[i] <= MAXSECT)
+			cfb->mfat[i] = ENDOFCHAIN;
+
+	seen = (uint8_t *)_cfb_buf(cfb, &cfb->scratch, &cfb->scratchcap, 
+			cfb->mfatn / 8 + 1);
+	if (!seen){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	memset(seen, 0, cfb->mfatn / 8 + 1);
+	for (sid = 1; sid < cfb->dirn; ++sid) {
+		cfb_dir * dir = &cfb->dirs[sid];
+		if (dir->_mse != STGTY_STREAM || dir->_ulSize >= cutoff || 
+				dir->_ulSize == 0)
+			continue;
+		_cfb_validate_dir(cfb, dir, 
+				_cfb_validate_chain(cfb->mfat, mn, seen, dir->_sectStart,
+					(dir->_ulSize + msize - 1) / msize), msize);
+	}
+	return 0;
+}
+#undef _CFB_SEEN
+#undef _CFB_SEEN_SET
+#endif // CFB_NO_FAT_CACHE
+
+// forget tables of file - buffers are kept
+static void _cfb_clear_tables(struct cfb * cfb){
+	cfb->difatn = 0;
+	cfb->fatn = 0;
+	cfb->mfatsectn = 0;
+	cfb->mfatn = 0;
+	cfb->dirn = 0;
+	cfb->dirhashn = 0;
+	cfb->damaged = false;
+}
+
+// free tables loaded to memory
+static void _cfb_free_tables(struct cfb * cfb){
+	_cfb_clear_tables(cfb);
+	_cfb_cache_free(cfb);
+#define _CFB_FREE_BUF(buf, cap) \
+	_cfb_free(cfb, buf); buf = NULL; cap = 0;
+	_CFB_FREE_BUF(cfb->difat, cfb->difatcap);
+	_CFB_FREE_BUF(cfb->fat, cfb->fatcap);
+	_CFB_FREE_BUF(cfb->mfatsect, cfb->mfatsectcap);
+	_CFB_FREE_BUF(cfb->mfat, cfb->mfatcap);
+	_CFB_FREE_BUF(cfb->dirs, cfb->dirscap);
+	_CFB_FREE_BUF(cfb->dirhash, cfb->dirhashcap);
+	_CFB_FREE_BUF(cfb->scratch, cfb->scratchcap);
+	_CFB_FREE_BUF(cfb->msects, cfb->msectscap);
+#undef _CFB_FREE_BUF
+}
+
+// read compound file from backend set in cfb
+static int _cfb_init(struct cfb * cfb){
 #ifdef DEBUG
 	LOG("start");
 #endif
 
-	memset(cfb, 0, sizeof(struct cfb));
-	
 	int error = 0;
 
 	int i; //iterator 
 	
-	off_t p; // offset in stream 
-	
-	cfb->fp   = fp;
+	_CFB_STAT_START(t);
 	cfb->biteOrder = false;
 	
-	//get byte order
+	//get byte order (header is read past cache - it may be
+	//left from previous file of cfb_reopen)
 	uint16_t byteOrder;
-	fseek(fp, 0x01C, SEEK_SET);	
-	if (fread(&byteOrder, 2, 1, fp) != 1) {
+	if (_cfb_read_io(cfb, 0x01C, &byteOrder, 2)) {
 #ifdef DEBUG
 	LOG("error to get byte orger");
 #endif		
@@ -972,8 +2797,7 @@ static int _cfb_init(struct cfb * cfb, FILE *fp){
 
 	// get file header 
 	// Header is always 512 bytes long and is always located at offset zero (0).
-	fseek(fp, 0, SEEK_SET);	
-	if (fread(&cfb->header, 512, 1, fp) != 1){
+	if (_cfb_read_io(cfb, 0, &cfb->header, 512)){
 #ifdef DEBUG
 	LOG("can't read file header");
 #endif									
@@ -1031,120 +2855,237 @@ static int _cfb_init(struct cfb * cfb, FILE *fp){
 		return CFB_SIG_ERR;
 	}
 
-	if (cfb->header._csectMiniFat > 0){
+	/* The sector size MUST be 512 bytes for version 3 and 4096
+	 * bytes for version 4 */
+	if (cfb->header._uSectorShift != 9 && cfb->header._uSectorShift != 12){
 #ifdef DEBUG
-	LOG("get mini stream");
+	LOG("wrong sector shift: %u", cfb->header._uSectorShift);
 #endif									 
-/*
- * The mini stream is chained within the FAT in exactly the same fashion as any normal stream. 
- * The mini stream's starting sector is referenced in the first directory entry (root storage 
- * stream ID 0).
- */	
-		cfb_get_dir_by_sid(cfb, &(cfb->root), 0);
-		cfb->ministream = cfb_get_stream_by_dir(cfb, &(cfb->root));
+		ERR("can't read MS CFB file");		 
+		return CFB_HEADER_ERR;
+	}
 
-	} else {
-		LOG("No miniFAT stream in file\n");
+	/* The mini sector size MUST be 64 bytes - it is shift of
+	 * sizes and offsets, so it must be less then sector shift */
+	if (cfb->header._uMiniSectorShift >= cfb->header._uSectorShift){
+#ifdef DEBUG
+	LOG("wrong mini sector shift: %u", cfb->header._uMiniSectorShift);
+#endif									 
+		ERR("can't read MS CFB file");		 
+		return CFB_HEADER_ERR;
 	}
-	
+
+	_CFB_STAT_TIME(cfb, ns_header, t);
+
+	// cache pages of sector size - header is not cached; cache
+	// of previous file (cfb_reopen) is emptied by cfb_reset and
+	// is reused for same sector size
+	DWORD psize = (DWORD)1 << cfb->header._uSectorShift;
+	if (cfb->cache.npages && (cfb->io.data || cfb->cache.psize != psize))
+		_cfb_cache_free(cfb);
+	if (cfb->options.cache_size && !cfb->io.data && !cfb->cache.npages){
+		error = _cfb_cache_init(cfb, cfb->options.cache_size, psize);
+		if (error)
+			return error;
+	}
+
+#ifdef CFB_STATS
+	t = _cfb_stats_now();
+#endif
+	error = _cfb_load_difat(cfb);
+#ifndef CFB_NO_FAT_CACHE
+	if (!error)
+		error = _cfb_load_fat(cfb);
+#endif
+	if (!error)
+		error = _cfb_load_mfat(cfb);
+	if (error){
+		ERR("can't read MS CFB file FAT");		 
+		return error;
+	}
+	_CFB_STAT_TIME(cfb, ns_fat, t);
+
+#ifdef CFB_STATS
+	t = _cfb_stats_now();
+#endif
+	error = _cfb_load_dirs(cfb);
+#ifndef CFB_NO_FAT_CACHE
+	if (!error)
+		error = _cfb_validate(cfb);
+#endif
+	if (error){
+		ERR("can't read MS CFB file directory");		 
+		return error;
+	}
+	cfb_get_dir_by_sid(cfb, &(cfb->root), 0);
+	_CFB_STAT_TIME(cfb, ns_dir, t);
+
 	return error;
 }
 
-static int cfb_open(struct cfb * cfb, const char * filename){
-	FILE * newfile;
-	FILE * fp = fopen(filename, "r");
-	if (!fp){
-#ifdef DEBUG
-	LOG("can't open file: %s", filename);
-#endif		
-		return -1;
+// read compound file from backend copied to cfb - on error 
+// backend is not closed
+static int _cfb_open(struct cfb * cfb){
+	if (!cfb->io.data && !cfb->io.read_at){
+		ERR("no read function in backend");
+		memset(&cfb->io, 0, sizeof(struct cfb_io));
+		return CFB_READ_ERR;
+	}
+
+	int error = _cfb_init(cfb);
+	if (error)
+		memset(&cfb->io, 0, sizeof(struct cfb_io));
+	return error;
+}
+
+/*
+ * Open compound file from I/O backend with options (may be
+ * NULL). The backend is copied to cfb and is closed in
+ * cfb_close - on error it is not closed.
+ */
+static int cfb_open_io_ex(struct cfb * cfb, const struct cfb_io * io, 
+		const struct cfb_options * options)
+{
+	memset(cfb, 0, sizeof(struct cfb));
+	cfb->io = *io;
+	if (options)
+		cfb->options = *options;
+#ifndef CFB_NO_THREADS
+	pthread_mutex_init(&cfb->lock, NULL);
+#endif
+
+	int error = _cfb_open(cfb);
+	if (error){
+		_cfb_free_tables(cfb);
+#ifndef CFB_NO_THREADS
+		pthread_mutex_destroy(&cfb->lock);
+#endif
 	}
+	return error;
+}
+
+static int cfb_open_io(struct cfb * cfb, const struct cfb_io * io){
+	return cfb_open_io_ex(cfb, io, NULL);
+}
+
+/*
+ * Open compound file from buffer in memory. Data is parsed
+ * in place and is not copied - buffer should be valid until
+ * cfb_close
+ */
+static int cfb_open_mem(struct cfb * cfb, const void * data, size_t len){
+	struct cfb_io io;
+	cfb_io_mem(&io, data, len);
+	return cfb_open_io(cfb, &io);
+}
+
+static void _cfb_io_heap_close(void * ctx){
+	free(ctx);
+}
 
+/*
+ * Set backend for FILE: regular file is mapped to memory (or
+ * read with stdio), non-seekable file (pipe) is read to
+ * memory buffer. If own is true FILE is closed (at once if
+ * it is not needed or in cfb_close). On error FILE is not
+ * closed
+ */
+static int _cfb_io_file(struct cfb_io * io, FILE * fp, bool own){
 	if (fseek(fp,0,SEEK_SET) == -1) {
 		if ( errno == ESPIPE ) {
-			//We got non-seekable file, create temp file
+			//We got non-seekable file, read it to memory
 #ifdef DEBUG
-	LOG("non-seekable file, create temp file...");
+	LOG("non-seekable file, read to memory...");
 #endif			
-			if((newfile=tmpfile()) == NULL) {
-#ifdef DEBUG
-	LOG("can't create temp file");
-#endif				
-				return -1;
+			size_t size = 0, cap = BUFSIZ * 16; 
+			uint8_t * buf = (uint8_t *)malloc(cap);
+			size_t n;
+			while (buf && (n = fread(buf + size, 1, cap - size, fp)) > 0) {
+				size += n;
+				if (size == cap){
+					cap *= 2;
+					uint8_t * tmp = (uint8_t *)realloc(buf, cap);
+					if (!tmp)
+						free(buf);
+					buf = tmp;
+				}
 			}
-			int ch;
-			while ((ch = fgetc(fp)) != EOF)
-				fputc(ch, newfile);
-			
-			fclose(fp);
-			fseek(newfile,0,SEEK_SET);
+			if (!buf){
+				ERR("can't allocate memory for file");
+				return CFB_ALLOC_ERR;
+			}
+			cfb_io_mem(io, buf, size);
+			io->ctx = buf;
+			io->close = _cfb_io_heap_close;
 		} else {
 			ERR("can't open file");		 
-			return -1;
+			return CFB_READ_ERR;
 		}
-	} else {
-		newfile=fp;
-	}	
-	
-	return _cfb_init(cfb, newfile); 
-};
+	} 
+#ifndef CFB_NO_MMAP
+	else if (cfb_io_mmap(io, fileno(fp)) == 0) {
+		// mapping does not need file
+	}
+#endif
+	else {
+		cfb_io_stdio(io, fp, own);
+		return 0;
+	}
 
+	if (own)
+		fclose(fp);
+	return 0;
+}
 
-//resturn len of utf16 string
-static size_t _utf8_to_utf16(const char * utf8, int len, WORD * utf16){
-	int i;
-	char *ptr = (char *)utf8;
-	while (*ptr){ //iterate chars
-		
-		uint8_t utf8_char[4];
+/*
+ * Open compound file from FILE. Regular file is mapped to
+ * memory (or read with stdio), non-seekable file (pipe) is
+ * read to memory buffer. FILE is not closed in cfb_close
+ */
+static int cfb_open_fp(struct cfb * cfb, FILE * fp){
+	struct cfb_io io;
+	int error = _cfb_io_file(&io, fp, false);
+	if (error)
+		return error;
+
+	error = cfb_open_io(cfb, &io);
+	if (error && io.close)
+		io.close(io.ctx);
+	return error;
+}
 
-		//get utf32
-		uint16_t utf16_char;
-		if ((*ptr & 240) == 240) {
-			//take last 3 bit from first char
-			uint32_t byte0 = (*ptr++ & 7) << 18;	
-			
-			//take last 6 bit from second char
-			uint16_t byte1 = (*ptr++ & 63) << 12;	
-			
-			//take last 6 bit from third char
-			uint16_t byte2 = (*ptr++ & 63) << 6;	
-			
-			//take last 6 bit from forth char
-			uint16_t byte3 = *ptr++ & 63;	
-			
-			utf16_char = (byte0 | byte1 | byte2 | byte3);					
-		} 
-		else if ((*ptr & 224) == 224) {
-			//take last 4 bit from first char
-			uint16_t byte0 = (*ptr++ & 15) << 12;	
-			
-			//take last 6 bit from second char
-			uint16_t byte1 = (*ptr++ & 63) << 6;	
-			
-			//take last 6 bit from third char
-			uint16_t byte2 = *ptr++ & 63;	
-
-			utf16_char = (byte0 | byte1 | byte2);
-		} 
-		else if ((*ptr & 192) == 192){
-			//take last 5 bit from first char
-			uint16_t byte0 = (*ptr++ & 31) << 6;	
-			
-			//take last 6 bit from second char
-			uint16_t byte1 = *ptr++ & 63;	
-
-			utf16_char = (byte0 | byte1);
-		}
-		else {
-			utf16_char = *ptr++;
-		} 				
-					
-		utf16[i++] = utf16_char;
+/*
+ * Open compound file with options (may be NULL)
+ */
+static int cfb_open_ex(struct cfb * cfb, const char * filename, 
+		const struct cfb_options * options)
+{
+	FILE * fp = fopen(filename, "r");
+	if (!fp){
+#ifdef DEBUG
+	LOG("can't open file: %s", filename);
+#endif		
+		return -1;
 	}
-	return i;
+
+	struct cfb_io io;
+	int error = _cfb_io_file(&io, fp, true);
+	if (error){
+		fclose(fp);
+		return error;
+	}
+
+	error = cfb_open_io_ex(cfb, &io, options);
+	if (error && io.close)
+		io.close(io.ctx);
+	return error;
+};
+
+static int cfb_open(struct cfb * cfb, const char * filename){
+	return cfb_open_ex(cfb, filename, NULL);
 }
 
+
 #define cfb_get_dir(cfb, dir, arg)\
 	_Generic((arg), \
 			char*: cfb_get_dir_by_name, \
@@ -1153,28 +3094,694 @@ static size_t _utf8_to_utf16(const char * utf8, int len, WORD * utf16){
 
 
 
+/*
+ * Execute callback for each directory entry (root entry is
+ * first). Unused entries (free entries may be anywhere in
+ * directory) are skipped. Return 1 if stopped by callback
+ */
 static int cfb_get_dirs(struct cfb * cfb, void * user_data,
 			int(*callback)(void * user_data, cfb_dir dir))
 {
-	int i=0, c;
-	cfb_dir dir;
-	c = cfb_get_dir_by_sid(cfb, &dir, i++);
-	while(c == 0 && dir._ab[0]){
+	SID i;
+	for (i = 0; i < cfb->dirn; ++i) {
+		if (cfb->dirs[i]._mse == STGTY_INVALID)
+			continue;
+		_CFB_STAT_INC(cfb, dir_reads);
 		if (callback){
-			if (callback(user_data, dir)){
+			if (callback(user_data, cfb->dirs[i])){
 				return 1;
 			}
 		}
-		c = cfb_get_dir_by_sid(cfb, &dir, i++);
 	}
 
 	return 0;
 }
 
+/*
+ * Bulk extraction
+ * All streams are splited to jobs of not more then
+ * CFB_EXTRACT_CHUNK bytes, jobs are sorted by size (big
+ * first) and are taken by worker threads one by one - so big
+ * stream is read by all threads and many small mini streams
+ * fill the end of work.
+ */
+#ifndef CFB_EXTRACT_CHUNK
+#define CFB_EXTRACT_CHUNK (1024 * 1024)
+#endif
+
+struct _cfb_extract_job {
+	SID stream;        // index of stream
+	ULONG offset;      // offset in stream
+	ULONG len;         // length of data
+};
+
+struct _cfb_extract {
+	struct cfb * cfb;
+	SID * sids;        // SIDs of streams
+	cfb_stream * streams;
+	struct _cfb_extract_job * jobs;
+	size_t njobs;
+	size_t next;       // next job to take
+	int stop;          // stopped by callback or error
+	int error;         // error code
+	void * user_data;
+	int (*callback)(void * user_data, SID sid, const cfb_dir * dir, 
+			ULONG offset, const uint8_t * data, size_t len);
+};
+
+static int _cfb_extract_job_compare(const void * a, const void * b){
+	const struct _cfb_extract_job * j1 = (const struct _cfb_extract_job *)a;
+	const struct _cfb_extract_job * j2 = (const struct _cfb_extract_job *)b;
+	if (j1->len != j2->len)
+		return j1->len > j2->len ? -1 : 1;
+	if (j1->stream != j2->stream)
+		return j1->stream < j2->stream ? -1 : 1;
+	return j1->offset < j2->offset ? -1 : 1;
+}
+
+// context of callback for part of stream
+struct _cfb_extract_part {
+	struct _cfb_extract * ex;
+	SID sid;
+	const cfb_dir * dir;
+};
+
+static int _cfb_extract_callback(void * user_data, ULONG offset, 
+		const uint8_t * data, size_t len)
+{
+	struct _cfb_extract_part * part = (struct _cfb_extract_part *)user_data;
+	if (_CFB_ATOMIC_GET(&part->ex->stop))
+		return 1;
+	return part->ex->callback(part->ex->user_data, part->sid, part->dir, 
+			offset, data, len);
+}
+
+static void * _cfb_extract_worker(void * arg){
+	struct _cfb_extract * ex = (struct _cfb_extract *)arg;
+	uint8_t * buf = NULL;
+
+	while (!_CFB_ATOMIC_GET(&ex->stop)) {
+		size_t j = _CFB_ATOMIC_INC(&ex->next);
+		if (j >= ex->njobs)
+			break;
+		struct _cfb_extract_job * job = &ex->jobs[j];
+		cfb_stream * stream = &ex->streams[job->stream];
+		struct _cfb_extract_part part = 
+			{ex, ex->sids[job->stream], &stream->dir};
+
+		if (job->len == 0){
+			// empty stream
+			if (ex->callback(ex->user_data, part.sid, part.dir, 0, NULL, 0))
+				_CFB_ATOMIC_SET(&ex->stop, 1);
+			continue;
+		}
+
+		int error = _cfb_stream_chunks(stream, job->offset, 
+				job->offset + job->len, &buf, &part, _cfb_extract_callback);
+		if (error > 0)
+			_CFB_ATOMIC_SET(&ex->error, error);
+		if (error)
+			_CFB_ATOMIC_SET(&ex->stop, 1);
+	}
+
+	_cfb_free(ex->cfb, buf);
+	return NULL;
+}
+
+/*
+ * function `cfb_extract_all`
+ * Read data of all streams with nthreads worker threads (0 -
+ * number of CPU) and execute callback for each part of
+ * stream data: offset is offset of data in stream, parts of
+ * one stream come in any order and from any thread (callback
+ * should be thread safe). Empty streams have one callback
+ * with len 0. Return 0 on success, -1 if stopped by callback
+ * (return non 0 in callback) or error code.
+ */
+static int cfb_extract_all(struct cfb * cfb, int nthreads, void * user_data,
+		int (*callback)(void * user_data, SID sid, const cfb_dir * dir, 
+			ULONG offset, const uint8_t * data, size_t len))
+{
+	SID i, n = 0;
+	size_t k;
+	struct _cfb_extract ex;
+	memset(&ex, 0, sizeof(ex));
+	ex.cfb = cfb;
+	ex.user_data = user_data;
+	ex.callback = callback;
+
+	ex.sids = (SID *)_cfb_alloc(cfb, cfb->dirn * sizeof(SID));
+	ex.streams = (cfb_stream *)_cfb_alloc(cfb, cfb->dirn * sizeof(cfb_stream));
+	if (!ex.sids || !ex.streams){
+		ex.error = CFB_ALLOC_ERR;
+		goto cfb_extract_all_end;
+	}
+	memset(ex.streams, 0, cfb->dirn * sizeof(cfb_stream));
+
+	// open streams and count jobs
+	for (i = 0; i < cfb->dirn; ++i) {
+		if (cfb->dirs[i]._mse != STGTY_STREAM)
+			continue;
+		ex.error = cfb_stream_open(cfb, &cfb->dirs[i], &ex.streams[n]);
+		if (ex.error)
+			goto cfb_extract_all_end;
+		ex.sids[n] = i;
+		ULONG size = cfb_stream_size(&ex.streams[n]);
+		ex.njobs += size ? (size - 1) / CFB_EXTRACT_CHUNK + 1 : 1;
+		n++;
+	}
+	
+	ex.jobs = (struct _cfb_extract_job *)_cfb_alloc(cfb, 
+			(ex.njobs + 1) * sizeof(struct _cfb_extract_job));
+	if (!ex.jobs){
+		ex.error = CFB_ALLOC_ERR;
+		goto cfb_extract_all_end;
+	}
+	for (i = 0, k = 0; i < n; ++i) {
+		ULONG size = cfb_stream_size(&ex.streams[i]), off = 0;
+		do {
+			ex.jobs[k].stream = i;
+			ex.jobs[k].offset = off;
+			ex.jobs[k].len = size - off < CFB_EXTRACT_CHUNK ? 
+				size - off : CFB_EXTRACT_CHUNK;
+			off += ex.jobs[k++].len;
+		} while (off < size);
+	}
+	qsort(ex.jobs, ex.njobs, sizeof(struct _cfb_extract_job), 
+			_cfb_extract_job_compare);
+
+#ifndef CFB_NO_THREADS
+	if (nthreads <= 0)
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if ((size_t)nthreads > ex.njobs)
+		nthreads = ex.njobs;
+	if (nthreads > 1){
+		pthread_t threads[nthreads];
+		int started = 0;
+		for (started = 0; started < nthreads; ++started) 
+			if (pthread_create(&threads[started], NULL, 
+						_cfb_extract_worker, &ex))
+				break;
+		// current thread works too if some threads are not started
+		if (started < nthreads)
+			_cfb_extract_worker(&ex);
+		for (i = 0; i < (SID)started; ++i)
+			pthread_join(threads[i], NULL);
+	} else
+#endif
+		_cfb_extract_worker(&ex);
+
+	if (!ex.error && ex.stop)
+		ex.error = -1;
+
+cfb_extract_all_end:
+	if (ex.streams)
+		for (i = 0; i < n; ++i)
+			cfb_stream_close(&ex.streams[i]);
+	_cfb_free(cfb, ex.streams);
+	_cfb_free(cfb, ex.sids);
+	_cfb_free(cfb, ex.jobs);
+	return ex.error;
+}
+
+/*
+ * Close file of cfb, but keep options, cache and buffers of
+ * tables to open next file with cfb_reopen - in batch of
+ * files tables are allocated only for file larger then
+ * previous ones. cfb_close should be called after last file
+ */
+static void cfb_reset(struct cfb * cfb){
+	cfb_stream_close(&cfb->mstream);
+	memset(&cfb->mstream, 0, sizeof(cfb_stream));
+	cfb->mstream_ready = false;
+	if (cfb->io.close)
+		cfb->io.close(cfb->io.ctx);
+	memset(&cfb->io, 0, sizeof(struct cfb_io));
+	if (cfb->index_close){
+		// tables are in index
+		cfb->difat = cfb->fat = cfb->mfatsect = cfb->mfat = NULL;
+		cfb->dirs = NULL;
+		cfb->dirhash = NULL;
+		cfb->difatcap = cfb->fatcap = cfb->mfatsectcap = cfb->mfatcap = 0;
+		cfb->dirscap = cfb->dirhashcap = 0;
+		cfb->index_close(cfb->index);
+	}
+	cfb->index = NULL;
+	cfb->index_close = NULL;
+	cfb->index_chain = NULL;
+	memset(&cfb->header, 0, sizeof(cfb_header));
+	memset(&cfb->root, 0, sizeof(cfb_dir));
+	_cfb_clear_tables(cfb);
+	_cfb_cache_clear(&cfb->cache);
+#ifdef CFB_STATS
+	memset(&cfb->stats, 0, sizeof(struct cfb_stats));
+	cfb->stats_pos = 0;
+#endif
+}
+
+/*
+ * Open next compound file from I/O backend with cfb that was
+ * opened before (current file is closed with cfb_reset). On
+ * error backend is not closed, and cfb may be reopened again
+ * or closed with cfb_close
+ */
+static int cfb_reopen_io(struct cfb * cfb, const struct cfb_io * io){
+	cfb_reset(cfb);
+	cfb->io = *io;
+	return _cfb_open(cfb);
+}
+
+static int cfb_reopen_mem(struct cfb * cfb, const void * data, size_t len){
+	struct cfb_io io;
+	cfb_io_mem(&io, data, len);
+	return cfb_reopen_io(cfb, &io);
+}
+
+/*
+ * Open next compound file with cfb that was opened before.
+ * Regular file is mapped with mapping kept in cfb, so no
+ * memory is allocated for backend
+ */
+static int cfb_reopen(struct cfb * cfb, const char * filename){
+	cfb_reset(cfb);
+#ifndef CFB_NO_MMAP
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0){
+#ifdef DEBUG
+	LOG("can't open file: %s", filename);
+#endif		
+		return -1;
+	}
+	struct cfb_io io;
+	int mapped = _cfb_io_mmap_init(&io, fd, &cfb->map) == 0;
+	close(fd);
+	if (mapped){
+		io.close = _cfb_io_mmap_unmap;
+		int error = cfb_reopen_io(cfb, &io);
+		if (error)
+			_cfb_io_mmap_unmap(&cfb->map);
+		return error;
+	}
+#endif
+	// pipes and small files are opened as in cfb_open
+	FILE * fp = fopen(filename, "r");
+	if (!fp){
+#ifdef DEBUG
+	LOG("can't open file: %s", filename);
+#endif		
+		return -1;
+	}
+
+	struct cfb_io fio;
+	int error = _cfb_io_file(&fio, fp, true);
+	if (error){
+		fclose(fp);
+		return error;
+	}
+
+	error = cfb_reopen_io(cfb, &fio);
+	if (error && fio.close)
+		fio.close(fio.ctx);
+	return error;
+}
+
 static void cfb_close(struct cfb * cfb){
-	fclose(cfb->ministream);
-	fclose(cfb->fp);
+	cfb_reset(cfb);
+#ifndef CFB_NO_THREADS
+	pthread_mutex_destroy(&cfb->lock);
+#endif
+	_cfb_free_tables(cfb);
+}
+
+#ifdef CFB_IO_URING
+/*
+ * Async engine (Linux io_uring)
+ * Stream reads of many files are submitted to one ring:
+ * plan of each read (extents of file) is queued as reads of
+ * file descriptor, and callback is called when all extents
+ * are read - so one thread may drive hundreds of reads in
+ * flight. Files are opened as usual (FAT is cached at open,
+ * so sector chains are resolved with no I/O). Files in memory
+ * (cfb_open maps regular files unless CFB_NO_MMAP) and
+ * backends with no file descriptor are read at once - open
+ * files with cfb_io_fd (or stdio with CFB_NO_MMAP) to read
+ * them with ring.
+ * Define CFB_IO_URING to use it.
+ */
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup 425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter 426
+#endif
+
+// read of stream queued to ring
+struct _cfb_uring_req {
+	void * user_data;
+	void (*callback)(void * user_data, ssize_t len);
+	size_t len;        // bytes to read
+	FSINDEX pending;   // extents not completed
+	int error;         // some extent is not read
+	int fd;            // file descriptor
+	struct _cfb_uring_ext {
+		struct _cfb_uring_req * req;
+		off_t off;
+		uint8_t * buf;
+		size_t len;
+	} ext[];           // extents of file to read
+};
+
+struct cfb_uring {
+	int fd;             // ring file descriptor
+	unsigned sq_entries;
+	unsigned cq_entries;
+	unsigned * sq_head;
+	unsigned * sq_tail;
+	unsigned * sq_mask;
+	unsigned * sq_array;
+	struct io_uring_sqe * sqes;
+	unsigned * cq_head;
+	unsigned * cq_tail;
+	unsigned * cq_mask;
+	struct io_uring_cqe * cqes;
+	void * sq_ring;     // mapped rings
+	size_t sq_ring_size;
+	void * cq_ring;
+	size_t cq_ring_size;
+	size_t sqes_size;
+	unsigned queued;    // SQEs not submitted
+	unsigned inflight;  // SQEs submitted and not completed
+	unsigned requests;  // reads not completed
+	uint64_t submitted; // SQEs submitted to ring (all time)
+};
+
+/*
+ * function `cfb_uring_init`
+ * Create ring for entries reads of extents in flight. Return
+ * 0 or errno
+ */
+static int cfb_uring_init(struct cfb_uring * ring, unsigned entries){
+	struct io_uring_params p;
+	memset(ring, 0, sizeof(struct cfb_uring));
+	memset(&p, 0, sizeof(p));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &p);
+	if (ring->fd < 0){
+		int error = errno;
+		ERR("io_uring_setup");
+		return error;
+	}
+	ring->sq_entries = p.sq_entries;
+	ring->cq_entries = p.cq_entries;
+
+	ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP){
+		if (ring->cq_ring_size > ring->sq_ring_size)
+			ring->sq_ring_size = ring->cq_ring_size;
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ|PROT_WRITE, 
+			MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+	if (ring->sq_ring == MAP_FAILED)
+		goto cfb_uring_init_err;
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_ring = ring->sq_ring;
+	else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ|PROT_WRITE, 
+				MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+		if (ring->cq_ring == MAP_FAILED){
+			munmap(ring->sq_ring, ring->sq_ring_size);
+			goto cfb_uring_init_err;
+		}
+	}
+	ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, 
+			PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, ring->fd, 
+			IORING_OFF_SQES);
+	if (ring->sqes == MAP_FAILED){
+		if (ring->cq_ring != ring->sq_ring)
+			munmap(ring->cq_ring, ring->cq_ring_size);
+		munmap(ring->sq_ring, ring->sq_ring_size);
+		goto cfb_uring_init_err;
+	}
+
+	uint8_t * sq = (uint8_t *)ring->sq_ring;
+	ring->sq_head  = (unsigned *)(sq + p.sq_off.head);
+	ring->sq_tail  = (unsigned *)(sq + p.sq_off.tail);
+	ring->sq_mask  = (unsigned *)(sq + p.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+	uint8_t * cq = (uint8_t *)ring->cq_ring;
+	ring->cq_head  = (unsigned *)(cq + p.cq_off.head);
+	ring->cq_tail  = (unsigned *)(cq + p.cq_off.tail);
+	ring->cq_mask  = (unsigned *)(cq + p.cq_off.ring_mask);
+	ring->cqes     = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	return 0;
+
+cfb_uring_init_err:;
+	int error = errno;
+	ERR("mmap");
+	close(ring->fd);
+	ring->fd = -1;
+	return error;
+}
+
+// submit queued SQEs and wait for min_complete completions
+static int _cfb_uring_enter(struct cfb_uring * ring, unsigned min_complete){
+	int n;
+	do {
+		n = syscall(__NR_io_uring_enter, ring->fd, ring->queued, min_complete, 
+				min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	} while (n < 0 && errno == EINTR);
+	if (n < 0){
+		ERR("io_uring_enter");
+		return -1;
+	}
+	ring->inflight += n;
+	ring->queued -= n;
+	ring->submitted += n;
+	return 0;
+}
+
+static int _cfb_uring_queue(struct cfb_uring * ring, struct _cfb_uring_ext * ext);
+
+// n extents of read are completed, return 1 if read is completed
+static int _cfb_uring_complete(struct cfb_uring * ring, 
+		struct _cfb_uring_req * req, FSINDEX n)
+{
+	req->pending -= n;
+	if (req->pending > 0)
+		return 0;
+	ring->requests--;
+	req->callback(req->user_data, req->error ? -1 : (ssize_t)req->len);
+	free(req);
+	return 1;
+}
+
+// process completions, return number of completed reads
+static int _cfb_uring_reap(struct cfb_uring * ring){
+	int done = 0;
+	unsigned head = *ring->cq_head;
+	while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+		struct io_uring_cqe * cqe = &ring->cqes[head & *ring->cq_mask];
+		struct _cfb_uring_ext * ext = 
+			(struct _cfb_uring_ext *)(uintptr_t)cqe->user_data;
+		int res = cqe->res;
+		head++;
+		__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+		ring->inflight--;
+
+		struct _cfb_uring_req * req = ext->req;
+		if (res > 0 && (size_t)res < ext->len){
+			// short read - queue rest of extent
+			ext->off += res;
+			ext->buf += res;
+			ext->len -= res;
+			res = _cfb_uring_queue(ring, ext) ? -1 : 0;
+			if (res == 0){
+				head = *ring->cq_head;
+				continue;
+			}
+		}
+		if (res < 0 || (size_t)res != ext->len){
+#ifdef DEBUG
+	LOG("Error to read %zu bytes from offset: %lld (%d)", 
+			ext->len, (long long)ext->off, res);
+#endif		
+			req->error = 1;
+		}
+		done += _cfb_uring_complete(ring, req, 1);
+		// completions may be processed in callback
+		head = *ring->cq_head;
+	}
+	return done;
+}
+
+// queue read of extent - ring is submitted (and completions
+// are processed) if it is full. Return 0 on success
+static int _cfb_uring_queue(struct cfb_uring * ring, struct _cfb_uring_ext * ext){
+	// completion queue should not overflow
+	while (ring->queued + ring->inflight >= ring->cq_entries ||
+			*ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) 
+				>= ring->sq_entries)
+	{
+		if (_cfb_uring_enter(ring, ring->inflight ? 1 : 0))
+			return -1;
+		_cfb_uring_reap(ring);
+	}
+
+	unsigned tail = *ring->sq_tail;
+	unsigned index = tail & *ring->sq_mask;
+	struct io_uring_sqe * sqe = &ring->sqes[index];
+	memset(sqe, 0, sizeof(struct io_uring_sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = ext->req->fd;
+	sqe->off = ext->off;
+	sqe->addr = (uintptr_t)ext->buf;
+	sqe->len = ext->len;
+	sqe->user_data = (uintptr_t)ext;
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	ring->queued++;
+	return 0;
+}
+
+// file descriptor of backend or -1
+static int _cfb_io_fileno(const struct cfb_io * io){
+	if (io->data)
+		return -1;
+	if (io->read_at == _cfb_io_fd_read)
+		return (int)(intptr_t)io->ctx;
+	if (io->read_at == _cfb_io_stdio_read)
+		return fileno((FILE *)io->ctx);
+	return -1;
+}
+
+/*
+ * function `cfb_uring_read`
+ * Queue read of len bytes of stream from offset to buf.
+ * callback is called from cfb_uring_wait (or at once if
+ * file has no file descriptor) with number of bytes read
+ * (less then len at end of stream) or -1 on error. Stream
+ * and buf should be valid until callback. Return 0 or error
+ * code
+ */
+static int cfb_uring_read(struct cfb_uring * ring, cfb_stream * stream, 
+		ULONG offset, void * buf, size_t len, void * user_data, 
+		void (*callback)(void * user_data, ssize_t len))
+{
+	ULONG size = cfb_stream_size(stream);
+	if (offset >= size)
+		len = 0;
+	else if (len > size - offset)
+		len = size - offset;
+
+	int fd = _cfb_io_fileno(&stream->cfb->io);
+	if (fd < 0 || len == 0){
+		// read with backend
+		callback(user_data, cfb_stream_read(stream, offset, buf, len));
+		return 0;
+	}
+
+	// count extents of plan
+	struct cfb_extent ext[CFB_IOVEC_MAX];
+	FSINDEX count = 0;
+	size_t done = 0;
+	while (done < len) {
+		size_t n = CFB_IOVEC_MAX;
+		size_t k = cfb_stream_plan(stream, offset + done, len - done, ext, &n);
+		count += n;
+		if (k == 0)
+			break;
+		done += k;
+	}
+	if (done < len){
+		ERR("can't plan read of stream");
+		return CFB_READ_ERR;
+	}
+
+	struct _cfb_uring_req * req = (struct _cfb_uring_req *)malloc(
+			sizeof(struct _cfb_uring_req) + 
+			(size_t)count * sizeof(struct _cfb_uring_ext));
+	if (!req){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	req->user_data = user_data;
+	req->callback = callback;
+	req->len = len;
+	req->pending = count;
+	req->error = 0;
+	req->fd = fd;
+
+	// set extents and buffers - plan is in order of stream
+	FSINDEX i = 0;
+	uint8_t * p = (uint8_t *)buf;
+	done = 0;
+	while (done < len) {
+		size_t n = CFB_IOVEC_MAX, j;
+		done += cfb_stream_plan(stream, offset + done, len - done, ext, &n);
+		for (j = 0; j < n; ++j, ++i) {
+			req->ext[i].req = req;
+			req->ext[i].off = ext[j].off;
+			req->ext[i].buf = p;
+			req->ext[i].len = ext[j].len;
+			p += ext[j].len;
+		}
+	}
+
+	ring->requests++;
+	for (i = 0; i < count; ++i) {
+		if (_cfb_uring_queue(ring, &req->ext[i])){
+			// extents not queued are failed
+			req->error = 1;
+			_cfb_uring_complete(ring, req, count - i);
+			break;
+		}
+	}
+	return 0;
+}
+
+/*
+ * function `cfb_uring_wait`
+ * Submit queued reads and wait until at least min_complete
+ * reads are completed (0 - do not wait). Callbacks are called
+ * from this function. Return number of completed reads or -1
+ * on error
+ */
+static int cfb_uring_wait(struct cfb_uring * ring, unsigned min_complete){
+	int done = _cfb_uring_reap(ring);
+	while (ring->queued || ((unsigned)done < min_complete && ring->requests)) {
+		unsigned wait = (unsigned)done < min_complete && ring->inflight + ring->queued;
+		if (_cfb_uring_enter(ring, wait))
+			return -1;
+		done += _cfb_uring_reap(ring);
+	}
+	return done;
+}
+
+// number of reads not completed
+static unsigned cfb_uring_pending(struct cfb_uring * ring){
+	return ring->requests;
+}
+
+/*
+ * function `cfb_uring_close`
+ * Wait for reads in flight and free ring
+ */
+static void cfb_uring_close(struct cfb_uring * ring){
+	if (ring->fd < 0)
+		return;
+	while (ring->requests && cfb_uring_wait(ring, ring->requests) >= 0)
+		;
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring != ring->sq_ring)
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+	ring->fd = -1;
 }
+#endif // CFB_IO_URING
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,550 @@
+/**
+ * File              : cfb_index.h
+ * Author            : Igor V. Sementsov <ig.kuzm@gmail.com>
+ * Date              : 14.10.2026
+ * Last Modified Date: 14.10.2026
+ * Last Modified By  : Igor V. Sementsov <ig.kuzm@gmail.com>
+ */
+
+#ifndef CFB_INDEX_H_
+#define CFB_INDEX_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "cfb.h"
+#include <sys/stat.h>
+
+#ifdef CFB_NO_FAT_CACHE
+#error "cfb_index.h needs FAT loaded to memory (CFB_NO_FAT_CACHE is defined)"
+#endif
+
+/*
+ * Sidecar index
+ * Tables resolved at open - DIFAT, FAT, miniFAT, directory
+ * with index by name and sector lists of all streams - are
+ * saved to index file next to compound file. Index is keyed
+ * by size and modification time of compound file and hash of
+ * its header, and is written in byte order of host. Open
+ * with index maps index file to memory and points tables of
+ * cfb to it, so no tables are read from compound file and
+ * streams are opened with no walk of FAT chains.
+ */
+#define CFB_INDEX_VERSION 2
+#define CFB_INDEX_MAGIC   "CFBINDEX"
+#define CFB_INDEX_ORDER   0x01020304
+
+enum {
+	CFB_INDEX_BYTEORDER = 0x1, // compound file is big-endian
+	CFB_INDEX_DAMAGED   = 0x2, // broken chains were truncated at open
+};
+
+// header of index file - offsets of tables are in bytes from
+// start of index and aligned to 8 bytes
+struct cfb_index_header {
+	char magic[8];         // CFB_INDEX_MAGIC
+	uint32_t version;      // CFB_INDEX_VERSION
+	uint32_t order;        // CFB_INDEX_ORDER in byte order of writer
+	uint64_t size;         // size of compound file
+	int64_t mtime;         // modification time of compound file (ns)
+	uint64_t hash;         // FNV-1a of 512 bytes of file header
+	uint64_t len;          // size of index file
+	cfb_header header;     // header of compound file (host byte order)
+	uint32_t flags;        // CFB_INDEX_BYTEORDER, CFB_INDEX_DAMAGED
+	uint32_t difatn;       // number of FAT sectors
+	uint32_t fatn;         // number of SECTs in FAT
+	uint32_t mfatsectn;    // number of miniFAT sectors
+	uint32_t mfatn;        // number of SECTs in miniFAT
+	uint32_t dirn;         // number of directory entries
+	uint32_t dirhashn;     // size of index of directory by name
+	uint32_t chainn;       // number of sector lists
+	uint64_t sectn;        // number of SECTs in all sector lists
+	uint64_t difat, fat, mfatsect, mfat, dirs, dirhash, chains, sects;
+};
+
+// sector list of stream - lists are sorted by key
+struct _cfb_index_chain {
+	uint64_t key;          // 1 << 32 for stream in ministream | first sector
+	uint64_t off;          // offset of list in sects (in SECTs)
+	uint32_t n;            // number of sectors
+	SID sid;               // directory entry of stream
+};
+
+// index opened for cfb
+struct _cfb_index {
+	void * addr;           // index data
+	size_t len;
+	bool mapped;           // data is mapped (or allocated)
+	const struct _cfb_index_chain * chains;
+	uint32_t chainn;
+	const SECT * sects;
+};
+
+static uint64_t _cfb_index_hash(const uint8_t * data, size_t len){
+	uint64_t h = 14695981039346656037ULL;
+	size_t i;
+	for (i = 0; i < len; ++i) {
+		h ^= data[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+static uint64_t _cfb_index_key(const cfb_dir * dir, bool mini){
+	return ((uint64_t)(mini ? 1 : 0) << 32) | dir->_sectStart;
+}
+
+static int _cfb_index_chain_compare(const void * a, const void * b){
+	uint64_t ka = ((const struct _cfb_index_chain *)a)->key;
+	uint64_t kb = ((const struct _cfb_index_chain *)b)->key;
+	return ka < kb ? -1 : ka > kb;
+}
+
+// sector list of stream of dir from index (cfb->index_chain)
+static const SECT * _cfb_index_chain(void * index, const cfb_dir * dir,
+		bool mini, FSINDEX * n)
+{
+	struct _cfb_index * ix = (struct _cfb_index *)index;
+	uint64_t key = _cfb_index_key(dir, mini);
+	uint32_t lo = 0, hi = ix->chainn;
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		if (ix->chains[mid].key < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == ix->chainn || ix->chains[lo].key != key)
+		return NULL;
+	*n = ix->chains[lo].n;
+	return ix->sects + ix->chains[lo].off;
+}
+
+static void _cfb_index_close(void * index){
+	struct _cfb_index * ix = (struct _cfb_index *)index;
+#ifndef CFB_NO_MMAP
+	if (ix->mapped)
+		munmap(ix->addr, ix->len);
+	else
+#endif
+		free(ix->addr);
+	free(ix);
+}
+
+// key of compound file - size and modification time in
+// nanoseconds (file rewritten in same second has other key)
+static int _cfb_index_stat(const char * filename, uint64_t * size,
+		int64_t * mtime)
+{
+	struct stat st;
+	if (stat(filename, &st)){
+#ifdef DEBUG
+	LOG("can't stat file: %s", filename);
+#endif
+		return -1;
+	}
+	*size = st.st_size;
+#if defined(__APPLE__)
+	long nsec = st.st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+	long nsec = 0;
+#else
+	long nsec = st.st_mtim.tv_nsec;
+#endif
+	*mtime = (int64_t)st.st_mtime * 1000000000 + nsec;
+	return 0;
+}
+
+// pad table of len bytes to 8 bytes
+static int _cfb_index_pad(FILE * fp, size_t len){
+	static const uint8_t pad[8] = {0};
+	if (len % 8 && fwrite(pad, 8 - len % 8, 1, fp) != 1)
+		return -1;
+	return 0;
+}
+
+// write table of len bytes and pad it to 8 bytes
+static int _cfb_index_fwrite(FILE * fp, const void * data, size_t len){
+	if (len && fwrite(data, len, 1, fp) != 1)
+		return -1;
+	return _cfb_index_pad(fp, len);
+}
+
+#define _CFB_INDEX_ALIGN(n) (((uint64_t)(n) + 7) & ~(uint64_t)7)
+
+/*
+ * Write index of compound file filename opened in cfb to
+ * file index (written to index.tmp and renamed), return 0 on
+ * success
+ */
+static int cfb_index_save(struct cfb * cfb, const char * filename,
+		const char * index)
+{
+	struct cfb_index_header h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, CFB_INDEX_MAGIC, 8);
+	h.version = CFB_INDEX_VERSION;
+	h.order = CFB_INDEX_ORDER;
+	if (_cfb_index_stat(filename, &h.size, &h.mtime))
+		return CFB_READ_ERR;
+	if (cfb->io.data && cfb->io.size != h.size)
+		return CFB_INDEX_ERR;
+	uint8_t raw[512];
+	if (_cfb_read(cfb, 0, raw, 512))
+		return CFB_READ_ERR|CFB_HEADER_ERR;
+	h.hash = _cfb_index_hash(raw, 512);
+	h.header = cfb->header;
+	h.flags = (cfb->biteOrder ? CFB_INDEX_BYTEORDER : 0) |
+		(cfb->damaged ? CFB_INDEX_DAMAGED : 0);
+	h.difatn = cfb->difatn;
+	h.fatn = cfb->fatn;
+	h.mfatsectn = cfb->mfatsectn;
+	h.mfatn = cfb->mfatn;
+	h.dirn = cfb->dirn;
+	h.dirhashn = cfb->dirhashn;
+
+	SID sid;
+	uint32_t i, k = 0;
+	uint64_t off;
+	int error = 0, e = 0;
+	char * tmp = NULL; // name of index.tmp
+	FILE * fp = NULL;
+
+	// sector lists of ministream and all streams
+	cfb_stream * streams = (cfb_stream *)calloc(cfb->dirn, sizeof(cfb_stream));
+	struct _cfb_index_chain * chains = (struct _cfb_index_chain *)malloc(
+			cfb->dirn * sizeof(struct _cfb_index_chain));
+	if (!streams || !chains){
+		ERR("malloc");
+		error = CFB_ALLOC_ERR;
+		goto cfb_index_save_end;
+	}
+	for (sid = 0; sid < cfb->dirn; ++sid) {
+		cfb_dir * dir = sid ? &cfb->dirs[sid] : &cfb->root;
+		if (sid && dir->_mse != STGTY_STREAM)
+			continue;
+		if (dir->_ulSize == 0 || dir->_sectStart > MAXSECT)
+			continue;
+		error = cfb_stream_open(cfb, dir, &streams[sid]);
+		if (error)
+			goto cfb_index_save_end;
+		if (streams[sid].sectn == 0)
+			continue;
+		chains[h.chainn].key = _cfb_index_key(dir, streams[sid].mini);
+		chains[h.chainn].n = streams[sid].sectn;
+		chains[h.chainn].sid = sid;
+		h.chainn++;
+	}
+	qsort(chains, h.chainn, sizeof(struct _cfb_index_chain),
+			_cfb_index_chain_compare);
+	// keys are unique in validated tables - streams with same
+	// first sector (if any) have same chain, so one list is kept
+	for (i = 0; i < h.chainn; ++i) {
+		if (k && chains[i].key == chains[k - 1].key)
+			continue;
+		chains[k] = chains[i];
+		chains[k].off = h.sectn;
+		h.sectn += chains[k].n;
+		k++;
+	}
+	h.chainn = k;
+
+	// offsets of tables
+	off = _CFB_INDEX_ALIGN(sizeof(h));
+#define _CFB_INDEX_SECTION(field, len) \
+	h.field = off; off += _CFB_INDEX_ALIGN(len);
+	_CFB_INDEX_SECTION(difat, (uint64_t)h.difatn * sizeof(SECT));
+	_CFB_INDEX_SECTION(fat, (uint64_t)h.fatn * sizeof(SECT));
+	_CFB_INDEX_SECTION(mfatsect, (uint64_t)h.mfatsectn * sizeof(SECT));
+	_CFB_INDEX_SECTION(mfat, (uint64_t)h.mfatn * sizeof(SECT));
+	_CFB_INDEX_SECTION(dirs, (uint64_t)h.dirn * sizeof(cfb_dir));
+	_CFB_INDEX_SECTION(dirhash, (uint64_t)h.dirhashn * sizeof(struct cfb_dirhash));
+	_CFB_INDEX_SECTION(chains, (uint64_t)h.chainn * sizeof(struct _cfb_index_chain));
+	_CFB_INDEX_SECTION(sects, h.sectn * sizeof(SECT));
+#undef _CFB_INDEX_SECTION
+	h.len = off;
+
+	tmp = (char *)malloc(strlen(index) + 5);
+	if (!tmp){
+		ERR("malloc");
+		error = CFB_ALLOC_ERR;
+		goto cfb_index_save_end;
+	}
+	strcpy(tmp, index);
+	strcat(tmp, ".tmp");
+	fp = fopen(tmp, "wb");
+	if (!fp){
+#ifdef DEBUG
+	LOG("can't open file: %s", tmp);
+#endif
+		error = CFB_WRITE_ERR;
+		goto cfb_index_save_end;
+	}
+	e = _cfb_index_fwrite(fp, &h, sizeof(h));
+	if (!e)
+		e = _cfb_index_fwrite(fp, cfb->difat, (size_t)h.difatn * sizeof(SECT));
+	if (!e)
+		e = _cfb_index_fwrite(fp, cfb->fat, (size_t)h.fatn * sizeof(SECT));
+	if (!e)
+		e = _cfb_index_fwrite(fp, cfb->mfatsect, (size_t)h.mfatsectn * sizeof(SECT));
+	if (!e)
+		e = _cfb_index_fwrite(fp, cfb->mfat, (size_t)h.mfatn * sizeof(SECT));
+	if (!e)
+		e = _cfb_index_fwrite(fp, cfb->dirs, (size_t)h.dirn * sizeof(cfb_dir));
+	if (!e)
+		e = _cfb_index_fwrite(fp, cfb->dirhash,
+				(size_t)h.dirhashn * sizeof(struct cfb_dirhash));
+	if (!e)
+		e = _cfb_index_fwrite(fp, chains,
+				(size_t)h.chainn * sizeof(struct _cfb_index_chain));
+	for (i = 0; !e && i < h.chainn; ++i)
+		if (fwrite(streams[chains[i].sid].sects,
+					(size_t)chains[i].n * sizeof(SECT), 1, fp) != 1)
+			e = -1;
+	if (!e)
+		e = _cfb_index_pad(fp, (size_t)h.sectn * sizeof(SECT));
+	if (fclose(fp))
+		e = -1;
+	if (e || rename(tmp, index)){
+		ERR("can't write index");
+		remove(tmp);
+		error = CFB_WRITE_ERR;
+	}
+
+cfb_index_save_end:
+	if (streams)
+		for (sid = 0; sid < cfb->dirn; ++sid)
+			cfb_stream_close(&streams[sid]);
+	free(streams);
+	free(chains);
+	free(tmp);
+	return error;
+}
+
+// check that table of n items of size is in index
+static bool _cfb_index_section(const struct cfb_index_header * h,
+		uint64_t off, uint64_t n, size_t size)
+{
+	return off % 8 == 0 && off >= sizeof(*h) && off <= h->len &&
+		n <= (h->len - off) / size;
+}
+
+// check index header and tables - index was written by
+// cfb_index_save, but file may be truncated or broken
+static bool _cfb_index_check(const struct cfb_index_header * h, size_t len){
+	if (len < sizeof(*h) || memcmp(h->magic, CFB_INDEX_MAGIC, 8) ||
+			h->version != CFB_INDEX_VERSION || h->order != CFB_INDEX_ORDER ||
+			h->len != len)
+		return false;
+	DWORD shift = h->header._uSectorShift;
+	if ((shift != 9 && shift != 12) || h->header._uMiniSectorShift >= shift)
+		return false;
+	FSINDEX SECTn = ((DWORD)1 << shift) / 4;
+	if (h->difatn == 0 || h->fatn != (uint64_t)h->difatn * SECTn ||
+			h->mfatn != (uint64_t)h->mfatsectn * SECTn || h->dirn == 0 ||
+			h->dirhashn < h->dirn || (h->dirhashn & (h->dirhashn - 1)))
+		return false;
+	if (!_cfb_index_section(h, h->difat, h->difatn, sizeof(SECT)) ||
+			!_cfb_index_section(h, h->fat, h->fatn, sizeof(SECT)) ||
+			!_cfb_index_section(h, h->mfatsect, h->mfatsectn, sizeof(SECT)) ||
+			!_cfb_index_section(h, h->mfat, h->mfatn, sizeof(SECT)) ||
+			!_cfb_index_section(h, h->dirs, h->dirn, sizeof(cfb_dir)) ||
+			!_cfb_index_section(h, h->dirhash, h->dirhashn,
+				sizeof(struct cfb_dirhash)) ||
+			!_cfb_index_section(h, h->chains, h->chainn,
+				sizeof(struct _cfb_index_chain)) ||
+			!_cfb_index_section(h, h->sects, h->sectn, sizeof(SECT)))
+		return false;
+
+	// entries of index by name and sector lists
+	const uint8_t * data = (const uint8_t *)h;
+	const struct cfb_dirhash * dirhash =
+		(const struct cfb_dirhash *)(data + h->dirhash);
+	uint32_t i;
+	for (i = 0; i < h->dirhashn; ++i)
+		if (dirhash[i].sid != NOSTREAM &&
+				(dirhash[i].sid >= h->dirn || dirhash[i].parent >= h->dirn))
+			return false;
+	const struct _cfb_index_chain * chains =
+		(const struct _cfb_index_chain *)(data + h->chains);
+	for (i = 0; i < h->chainn; ++i)
+		if (chains[i].off > h->sectn || chains[i].n > h->sectn - chains[i].off ||
+				chains[i].sid >= h->dirn ||
+				(i && chains[i].key <= chains[i - 1].key))
+			return false;
+
+	// directory - links are in directory and sizes of streams
+	// are in tables, as after _cfb_load_dirs and _cfb_validate
+	const cfb_dir * dirs = (const cfb_dir *)(data + h->dirs);
+	uint64_t fatsize = (uint64_t)h->fatn << shift;
+	uint64_t mfatsize = (uint64_t)h->mfatn << h->header._uMiniSectorShift;
+	if (dirs[0]._mse != STGTY_ROOT || dirs[0]._ulSize > fatsize)
+		return false;
+	for (i = 0; i < h->dirn; ++i) {
+		const cfb_dir * d = &dirs[i];
+		if (d->_mse > STGTY_ROOT || (i && d->_mse == STGTY_ROOT) ||
+				d->_cb > 64 ||
+				(d->_sidLeftSib != NOSTREAM && d->_sidLeftSib >= h->dirn) ||
+				(d->_sidRightSib != NOSTREAM && d->_sidRightSib >= h->dirn) ||
+				(d->_sidChild != NOSTREAM && d->_sidChild >= h->dirn))
+			return false;
+		if (i && d->_mse == STGTY_STREAM &&
+				d->_ulSize > (d->_ulSize < h->header._ulMiniSectorCutoff ?
+					mfatsize : fatsize))
+			return false;
+	}
+	return true;
+}
+
+// read index file to memory - map it if we can
+static struct _cfb_index * _cfb_index_load(const char * index){
+	struct _cfb_index * ix =
+		(struct _cfb_index *)calloc(1, sizeof(struct _cfb_index));
+	if (!ix)
+		return NULL;
+#ifndef CFB_NO_MMAP
+	int fd = open(index, O_RDONLY);
+	if (fd < 0){
+		free(ix);
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+		ix->len = st.st_size;
+		ix->addr = mmap(NULL, ix->len, PROT_READ, MAP_SHARED, fd, 0);
+		ix->mapped = ix->addr != MAP_FAILED;
+		if (!ix->mapped)
+			ix->addr = NULL;
+	}
+	close(fd);
+	if (ix->mapped)
+		return ix;
+#endif
+	FILE * fp = fopen(index, "rb");
+	long len = -1;
+	if (fp && fseek(fp, 0, SEEK_END) == 0)
+		len = ftell(fp);
+	if (len > 0 && fseek(fp, 0, SEEK_SET) == 0){
+		ix->len = len;
+		ix->addr = malloc(len);
+		if (ix->addr && fread(ix->addr, len, 1, fp) != 1){
+			free(ix->addr);
+			ix->addr = NULL;
+		}
+	}
+	if (fp)
+		fclose(fp);
+	if (!ix->addr){
+		free(ix);
+		return NULL;
+	}
+	return ix;
+}
+
+/*
+ * Open compound file filename with tables from index written
+ * by cfb_index_save. Return CFB_INDEX_ERR if there is no index
+ * or index is not of this file (size, modification time or
+ * header are changed) or it is broken - then file should be
+ * opened with cfb_open
+ */
+static int cfb_open_index(struct cfb * cfb, const char * filename,
+		const char * index)
+{
+	memset(cfb, 0, sizeof(struct cfb));
+	uint64_t size;
+	int64_t mtime;
+	if (_cfb_index_stat(filename, &size, &mtime))
+		return -1;
+
+	struct _cfb_index * ix = _cfb_index_load(index);
+	if (!ix)
+		return CFB_INDEX_ERR;
+	const struct cfb_index_header * h =
+		(const struct cfb_index_header *)ix->addr;
+	if (!_cfb_index_check(h, ix->len) || h->size != size || h->mtime != mtime){
+#ifdef DEBUG
+	LOG("index %s is not valid for file %s", index, filename);
+#endif
+		_cfb_index_close(ix);
+		return CFB_INDEX_ERR;
+	}
+
+	FILE * fp = fopen(filename, "r");
+	if (!fp){
+		_cfb_index_close(ix);
+		return -1;
+	}
+	int error = _cfb_io_file(&cfb->io, fp, true);
+	if (error){
+		fclose(fp);
+		_cfb_index_close(ix);
+		return error;
+	}
+
+	// header of file should be the same
+	uint8_t raw[512];
+	if (_cfb_read(cfb, 0, raw, 512) || _cfb_index_hash(raw, 512) != h->hash){
+		if (cfb->io.close)
+			cfb->io.close(cfb->io.ctx);
+		memset(&cfb->io, 0, sizeof(struct cfb_io));
+		_cfb_index_close(ix);
+		return CFB_INDEX_ERR;
+	}
+
+	const uint8_t * data = (const uint8_t *)ix->addr;
+	cfb->header = h->header;
+	cfb->biteOrder = h->flags & CFB_INDEX_BYTEORDER;
+	cfb->damaged = h->flags & CFB_INDEX_DAMAGED;
+	// tables are not changed after open - they are read only
+	cfb->difat = (SECT *)(data + h->difat);
+	cfb->difatn = h->difatn;
+	cfb->fat = (SECT *)(data + h->fat);
+	cfb->fatn = h->fatn;
+	cfb->mfatsect = (SECT *)(data + h->mfatsect);
+	cfb->mfatsectn = h->mfatsectn;
+	cfb->mfat = (SECT *)(data + h->mfat);
+	cfb->mfatn = h->mfatn;
+	cfb->dirs = (cfb_dir *)(data + h->dirs);
+	cfb->dirn = h->dirn;
+	cfb->dirhash = (struct cfb_dirhash *)(data + h->dirhash);
+	cfb->dirhashn = h->dirhashn;
+	cfb->root = cfb->dirs[0];
+
+	ix->chains = (const struct _cfb_index_chain *)(data + h->chains);
+	ix->chainn = h->chainn;
+	ix->sects = (const SECT *)(data + h->sects);
+	cfb->index = ix;
+	cfb->index_close = _cfb_index_close;
+	cfb->index_chain = _cfb_index_chain;
+#ifndef CFB_NO_THREADS
+	pthread_mutex_init(&cfb->lock, NULL);
+#endif
+	return 0;
+}
+
+/*
+ * Open compound file with index if it is valid, otherwise
+ * open file with cfb_open and write index for next open
+ * (errors of writing index are ignored)
+ */
+static int cfb_open_indexed(struct cfb * cfb, const char * filename,
+		const char * index)
+{
+	int error = cfb_open_index(cfb, filename, index);
+	if (error != CFB_INDEX_ERR)
+		return error;
+	error = cfb_open(cfb, filename);
+	if (!error)
+		cfb_index_save(cfb, filename, index);
+	return error;
+}
+
+#undef _CFB_INDEX_ALIGN
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CFB_INDEX_H_
@@ -0,0 +1,760 @@
+/**
+ * File              : cfb_writer.h
+ * Author            : Igor V. Sementsov <ig.kuzm@gmail.com>
+ * Date              : 14.10.2026
+ * Last Modified Date: 14.10.2026
+ * Last Modified By  : Igor V. Sementsov <ig.kuzm@gmail.com>
+ */
+
+#ifndef CFB_WRITER_H_
+#define CFB_WRITER_H_
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+#include "cfb.h"
+
+/*
+ * Writer
+ * Streams are written to output as they come: data of big
+ * streams goes to consecutive sectors with no copy, streams
+ * smaller then mini sector cutoff are collected in mini
+ * stream which is flushed sector by sector. FAT, miniFAT and
+ * directory are kept in memory and written once in
+ * cfb_writer_finish after all streams, then header is written
+ * at offset 0 (output must be seekable). Buffers are bounded
+ * by one sector and mini sector cutoff.
+ */
+
+// entry of directory under construction
+struct _cfb_writer_entry {
+	SID parent;        // SID of storage
+	WORD name[32];     // name in UTF-16
+	int len;           // number of WORDs of name
+};
+
+struct cfb_writer {
+	FILE * fp;
+	bool fpown;        // fp is closed in cfb_writer_finish
+	int error;         // first error - writer stops on error
+	int version;       // 3 or 4
+	DWORD ssize;       // sector size
+	DWORD cutoff;      // mini stream cutoff size
+
+	SECT * fat;        // FAT of written sectors
+	FSINDEX fatn;      // number of written sectors
+	FSINDEX fatcap;
+
+	SECT * mfat;       // miniFAT
+	FSINDEX mfatn;     // number of mini sectors
+	FSINDEX mfatcap;
+	uint8_t * msect;   // last sector of mini stream
+	SECT mlast;        // last sector of mini stream chain
+	SECT mfirst;       // first sector of mini stream chain
+
+	cfb_dir * dirs;    // directory entries
+	struct _cfb_writer_entry * entries;
+	SID dirn;
+	SID dircap;
+	SID * hash;        // index of entries by storage and name
+	ULONG hashn;       // size of index (power of 2)
+
+	SID stream;        // SID of opened stream or NOSTREAM
+	uint8_t * sbuf;    // data of stream until cutoff or last sector
+	size_t sbuflen;    // bytes in sbuf
+	uint64_t ssize_total; // bytes written to stream
+	SECT slast;        // last sector of stream chain
+};
+
+// append n sectors of buf to chain with last sector last,
+// return first of sectors or ENDOFCHAIN on error
+static SECT _cfb_writer_sectors(struct cfb_writer * w, const void * buf,
+		FSINDEX n, SECT * last)
+{
+	FSINDEX i;
+	if (w->error)
+		return ENDOFCHAIN;
+	if ((uint64_t)w->fatn + n > MAXSECT){
+		w->error = CFB_FAT_ERR;
+		return ENDOFCHAIN;
+	}
+	if (w->fatn + n > w->fatcap){
+		FSINDEX cap = w->fatcap ? w->fatcap : 1024;
+		while (cap < w->fatn + n)
+			cap *= 2;
+		SECT * fat = (SECT *)realloc(w->fat, (size_t)cap * sizeof(SECT));
+		if (!fat){
+			ERR("realloc");
+			w->error = CFB_ALLOC_ERR;
+			return ENDOFCHAIN;
+		}
+		w->fat = fat;
+		w->fatcap = cap;
+	}
+	if (n && fwrite(buf, w->ssize, n, w->fp) != n){
+		ERR("can't write file");
+		w->error = CFB_WRITE_ERR;
+		return ENDOFCHAIN;
+	}
+	SECT first = w->fatn;
+	if (n && *last != ENDOFCHAIN)
+		w->fat[*last] = first;
+	for (i = 0; i < n; ++i)
+		w->fat[first + i] = i + 1 < n ? first + i + 1 : ENDOFCHAIN;
+	if (n)
+		*last = first + n - 1;
+	w->fatn += n;
+	return first;
+}
+
+static void _cfb_writer_free(struct cfb_writer * w){
+	if (w->fpown && w->fp)
+		fclose(w->fp);
+	free(w->fat);
+	free(w->mfat);
+	free(w->msect);
+	free(w->dirs);
+	free(w->entries);
+	free(w->hash);
+	free(w->sbuf);
+	memset(w, 0, sizeof(struct cfb_writer));
+}
+
+static int _cfb_writer_init(struct cfb_writer * w, FILE * fp, bool own,
+		int version)
+{
+	memset(w, 0, sizeof(struct cfb_writer));
+	if (version != 3 && version != 4)
+		return -1;
+	w->fp = fp;
+	w->fpown = own;
+	w->version = version;
+	w->ssize = version == 4 ? 4096 : 512;
+	w->cutoff = 4096;
+	w->mlast = w->mfirst = ENDOFCHAIN;
+	w->stream = NOSTREAM;
+
+	w->msect = (uint8_t *)calloc(1, w->ssize);
+	w->sbuf = (uint8_t *)malloc(w->cutoff > w->ssize ? w->cutoff : w->ssize);
+	if (!w->msect || !w->sbuf){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+
+	// place of header - it is written in cfb_writer_finish
+	uint8_t header[4096] = {0};
+	if (fwrite(header, w->ssize, 1, fp) != 1){
+		ERR("can't write file");
+		return CFB_WRITE_ERR;
+	}
+
+	// root entry
+	if (w->dircap == 0){
+		w->dircap = 64;
+		w->dirs = (cfb_dir *)malloc(w->dircap * sizeof(cfb_dir));
+		w->entries = (struct _cfb_writer_entry *)
+			malloc(w->dircap * sizeof(struct _cfb_writer_entry));
+		if (!w->dirs || !w->entries){
+			ERR("malloc");
+			return CFB_ALLOC_ERR;
+		}
+	}
+	cfb_dir * root = &w->dirs[0];
+	memset(root, 0, sizeof(cfb_dir));
+	_utf8_to_utf16("Root Entry", 32, w->entries[0].name);
+	w->entries[0].len = 10;
+	w->entries[0].parent = NOSTREAM;
+	root->_mse = STGTY_ROOT;
+	root->_bflags = DE_BLACK;
+	root->_sidLeftSib = root->_sidRightSib = root->_sidChild = NOSTREAM;
+	w->dirn = 1;
+	return 0;
+}
+
+/*
+ * Open writer to file filename of version 3 (512 bytes
+ * sectors) or 4 (4096 bytes sectors), return 0 on success
+ */
+static int cfb_writer_open(struct cfb_writer * w, const char * filename,
+		int version)
+{
+	FILE * fp = fopen(filename, "wb");
+	if (!fp){
+		ERR("can't open file: %s", filename);
+		memset(w, 0, sizeof(struct cfb_writer));
+		return CFB_WRITE_ERR;
+	}
+	int error = _cfb_writer_init(w, fp, true, version);
+	if (error)
+		_cfb_writer_free(w);
+	return error;
+}
+
+/*
+ * Open writer to seekable fp (it is not closed in
+ * cfb_writer_finish)
+ */
+static int cfb_writer_open_fp(struct cfb_writer * w, FILE * fp, int version){
+	int error = _cfb_writer_init(w, fp, false, version);
+	if (error)
+		_cfb_writer_free(w);
+	return error;
+}
+
+// compare UTF-16 names case-insensitive
+static bool _cfb_writer_same(const struct _cfb_writer_entry * e, SID parent,
+		const WORD * name, int len)
+{
+	int i;
+	if (e->parent != parent || e->len != len)
+		return false;
+	for (i = 0; i < len; ++i)
+		if (_cfb_upper(e->name[i]) != _cfb_upper(name[i]))
+			return false;
+	return true;
+}
+
+// add entry sid to index, grow index twice when it is half
+// full, return 0 on success
+static int _cfb_writer_index(struct cfb_writer * w, SID sid){
+	ULONG i;
+	if ((sid + 1) * 2 > w->hashn){
+		ULONG n = w->hashn ? w->hashn * 2 : 256;
+		SID * hash = (SID *)malloc(n * sizeof(SID));
+		if (!hash){
+			ERR("malloc");
+			return CFB_ALLOC_ERR;
+		}
+		for (i = 0; i < n; ++i)
+			hash[i] = NOSTREAM;
+		free(w->hash);
+		w->hash = hash;
+		w->hashn = n;
+		for (i = 1; i < sid; ++i)
+			_cfb_writer_index(w, i);
+	}
+	struct _cfb_writer_entry * e = &w->entries[sid];
+	ULONG h = _cfb_dir_hash(e->parent, e->name, e->len) & (w->hashn - 1);
+	while (w->hash[h] != NOSTREAM)
+		h = (h + 1) & (w->hashn - 1);
+	w->hash[h] = sid;
+	return 0;
+}
+
+// return true if storage parent has entry with name
+static bool _cfb_writer_exists(struct cfb_writer * w, SID parent,
+		const WORD * name, int len)
+{
+	if (!w->hashn)
+		return false;
+	ULONG h = _cfb_dir_hash(parent, name, len) & (w->hashn - 1);
+	while (w->hash[h] != NOSTREAM) {
+		if (_cfb_writer_same(&w->entries[w->hash[h]], parent, name, len))
+			return true;
+		h = (h + 1) & (w->hashn - 1);
+	}
+	return false;
+}
+
+// add directory entry of type mse to storage parent, return
+// SID or NOSTREAM
+static SID _cfb_writer_entry(struct cfb_writer * w, SID parent,
+		const char * name, BYTE mse)
+{
+	if (w->error)
+		return NOSTREAM;
+	if (w->stream != NOSTREAM || parent >= w->dirn ||
+			(w->dirs[parent]._mse != STGTY_ROOT &&
+			 w->dirs[parent]._mse != STGTY_STORAGE))
+		return NOSTREAM;
+	// name is up to 31 characters
+	WORD name16[32];
+	int len = _utf8_to_utf16(name, 31, name16);
+	if (len <= 0 || _cfb_writer_exists(w, parent, name16, len))
+		return NOSTREAM;
+	if (w->dirn > 0xFFFFFFFA) // MAXREGSID
+		return NOSTREAM;
+
+	if (w->dirn == w->dircap){
+		SID cap = w->dircap * 2;
+		cfb_dir * dirs = (cfb_dir *)realloc(w->dirs, cap * sizeof(cfb_dir));
+		if (dirs)
+			w->dirs = dirs;
+		struct _cfb_writer_entry * entries = (struct _cfb_writer_entry *)
+			realloc(w->entries, cap * sizeof(struct _cfb_writer_entry));
+		if (entries)
+			w->entries = entries;
+		if (!dirs || !entries){
+			ERR("realloc");
+			w->error = CFB_ALLOC_ERR;
+			return NOSTREAM;
+		}
+		w->dircap = cap;
+	}
+
+	SID sid = w->dirn++;
+	cfb_dir * dir = &w->dirs[sid];
+	memset(dir, 0, sizeof(cfb_dir));
+	dir->_mse = mse;
+	dir->_sidLeftSib = dir->_sidRightSib = dir->_sidChild = NOSTREAM;
+	dir->_sectStart = mse == STGTY_STREAM ? ENDOFCHAIN : 0;
+	memcpy(w->entries[sid].name, name16, len * sizeof(WORD));
+	w->entries[sid].len = len;
+	w->entries[sid].parent = parent;
+	int error = _cfb_writer_index(w, sid);
+	if (error){
+		w->error = error;
+		return NOSTREAM;
+	}
+	return sid;
+}
+
+/*
+ * Add storage with name to storage parent (0 is root
+ * storage), return SID of storage or NOSTREAM on error
+ */
+static SID cfb_writer_add_storage(struct cfb_writer * w, SID parent,
+		const char * name)
+{
+	return _cfb_writer_entry(w, parent, name, STGTY_STORAGE);
+}
+
+/*
+ * Start stream with name in storage parent - data is added
+ * with cfb_writer_stream_write and stream is closed with
+ * cfb_writer_stream_end. Only one stream is written at time.
+ */
+static int cfb_writer_stream_begin(struct cfb_writer * w, SID parent,
+		const char * name)
+{
+	if (w->error)
+		return w->error;
+	SID sid = _cfb_writer_entry(w, parent, name, STGTY_STREAM);
+	if (sid == NOSTREAM)
+		return w->error ? w->error : -1;
+	w->stream = sid;
+	w->sbuflen = 0;
+	w->ssize_total = 0;
+	w->slast = ENDOFCHAIN;
+	return 0;
+}
+
+// move data of stream from sbuf to sectors - stream is not
+// mini stream
+static void _cfb_writer_flush_sbuf(struct cfb_writer * w){
+	FSINDEX n = w->sbuflen / w->ssize;
+	if (n == 0)
+		return;
+	SECT first = _cfb_writer_sectors(w, w->sbuf, n, &w->slast);
+	if (w->dirs[w->stream]._sectStart == ENDOFCHAIN)
+		w->dirs[w->stream]._sectStart = first;
+	memmove(w->sbuf, w->sbuf + (size_t)n * w->ssize,
+			w->sbuflen - (size_t)n * w->ssize);
+	w->sbuflen -= (size_t)n * w->ssize;
+}
+
+static int cfb_writer_stream_write(struct cfb_writer * w,
+		const void * data, size_t len)
+{
+	const uint8_t * p = (const uint8_t *)data;
+	if (w->error)
+		return w->error;
+	if (w->stream == NOSTREAM)
+		return -1;
+	if (w->ssize_total + len > 0xFFFFFFFFu){
+		w->error = CFB_WRITE_ERR;
+		return w->error;
+	}
+	bool big = w->ssize_total >= w->cutoff;
+	w->ssize_total += len;
+
+	if (!big){
+		// keep data while stream may be mini stream
+		if (w->ssize_total < w->cutoff){
+			memcpy(w->sbuf + w->sbuflen, p, len);
+			w->sbuflen += len;
+			return 0;
+		}
+		// fill sbuf to sector boundary and flush
+		size_t n = w->ssize - w->sbuflen % w->ssize;
+		if (n == w->ssize)
+			n = 0;
+		if (n > len)
+			n = len;
+		memcpy(w->sbuf + w->sbuflen, p, n);
+		w->sbuflen += n;
+		p += n; len -= n;
+		_cfb_writer_flush_sbuf(w);
+	}
+	else if (w->sbuflen){
+		// complete last sector
+		size_t n = w->ssize - w->sbuflen;
+		if (n > len)
+			n = len;
+		memcpy(w->sbuf + w->sbuflen, p, n);
+		w->sbuflen += n;
+		p += n; len -= n;
+		if (w->sbuflen == w->ssize)
+			_cfb_writer_flush_sbuf(w);
+	}
+
+	// full sectors go to file with no copy
+	FSINDEX nsect = len / w->ssize;
+	if (nsect){
+		SECT first = _cfb_writer_sectors(w, p, nsect, &w->slast);
+		if (w->dirs[w->stream]._sectStart == ENDOFCHAIN)
+			w->dirs[w->stream]._sectStart = first;
+		p += (size_t)nsect * w->ssize;
+		len -= (size_t)nsect * w->ssize;
+	}
+	memcpy(w->sbuf + w->sbuflen, p, len);
+	w->sbuflen += len;
+	return w->error;
+}
+
+// append data of mini stream to mini stream, return first
+// mini sector
+static SECT _cfb_writer_mini(struct cfb_writer * w, const uint8_t * data,
+		size_t len)
+{
+	DWORD msize = 64;
+	FSINDEX i, n = (len + msize - 1) / msize;
+	if (w->mfatn + n > w->mfatcap){
+		FSINDEX cap = w->mfatcap ? w->mfatcap : 1024;
+		while (cap < w->mfatn + n)
+			cap *= 2;
+		SECT * mfat = (SECT *)realloc(w->mfat, (size_t)cap * sizeof(SECT));
+		if (!mfat){
+			ERR("realloc");
+			w->error = CFB_ALLOC_ERR;
+			return ENDOFCHAIN;
+		}
+		w->mfat = mfat;
+		w->mfatcap = cap;
+	}
+	SECT first = w->mfatn;
+	for (i = 0; i < n; ++i) {
+		// mini sector in current sector of mini stream
+		DWORD off = (w->mfatn * msize) % w->ssize;
+		size_t k = len - (size_t)i * msize < msize ? len - (size_t)i * msize : msize;
+		memcpy(w->msect + off, data + (size_t)i * msize, k);
+		memset(w->msect + off + k, 0, msize - k);
+		w->mfat[w->mfatn] = i + 1 < n ? w->mfatn + 1 : ENDOFCHAIN;
+		w->mfatn++;
+		if (off + msize == w->ssize){
+			SECT s = _cfb_writer_sectors(w, w->msect, 1, &w->mlast);
+			if (w->mfirst == ENDOFCHAIN)
+				w->mfirst = s;
+		}
+	}
+	return first;
+}
+
+static int cfb_writer_stream_end(struct cfb_writer * w){
+	if (w->error)
+		return w->error;
+	if (w->stream == NOSTREAM)
+		return -1;
+	cfb_dir * dir = &w->dirs[w->stream];
+	dir->_ulSize = (ULONG)w->ssize_total;
+	if (w->ssize_total == 0)
+		dir->_sectStart = ENDOFCHAIN;
+	else if (w->ssize_total < w->cutoff)
+		dir->_sectStart = _cfb_writer_mini(w, w->sbuf, w->sbuflen);
+	else if (w->sbuflen){
+		// pad last sector
+		memset(w->sbuf + w->sbuflen, 0, w->ssize - w->sbuflen);
+		w->sbuflen = w->ssize;
+		_cfb_writer_flush_sbuf(w);
+	}
+	w->stream = NOSTREAM;
+	w->sbuflen = 0;
+	return w->error;
+}
+
+/*
+ * Add stream with name and len bytes of data to root
+ * storage, return 0 on success
+ */
+static int cfb_writer_add_stream(struct cfb_writer * w, const char * name,
+		const void * data, size_t len)
+{
+	int error = cfb_writer_stream_begin(w, 0, name);
+	if (!error)
+		error = cfb_writer_stream_write(w, data, len);
+	if (!error)
+		error = cfb_writer_stream_end(w);
+	return error;
+}
+
+// compare entries in CFB order: storage, length of name and
+// uppercased name
+static int _cfb_writer_compare(struct cfb_writer * w, SID a, SID b){
+	struct _cfb_writer_entry * ea = &w->entries[a], * eb = &w->entries[b];
+	int i;
+	if (ea->parent != eb->parent)
+		return ea->parent < eb->parent ? -1 : 1;
+	if (ea->len != eb->len)
+		return ea->len - eb->len;
+	for (i = 0; i < ea->len; ++i) {
+		WORD ca = _cfb_upper(ea->name[i]), cb = _cfb_upper(eb->name[i]);
+		if (ca != cb)
+			return ca - cb;
+	}
+	return 0;
+}
+
+// merge sort of SIDs with compare of writer
+static void _cfb_writer_sort(struct cfb_writer * w, SID * a, SID * tmp, SID n){
+	SID i, j, k, mid = n / 2;
+	if (n < 2)
+		return;
+	_cfb_writer_sort(w, a, tmp, mid);
+	_cfb_writer_sort(w, a + mid, tmp, n - mid);
+	for (i = 0, j = mid, k = 0; k < n; ++k) {
+		if (j >= n || (i < mid && _cfb_writer_compare(w, a[i], a[j]) <= 0))
+			tmp[k] = a[i++];
+		else
+			tmp[k] = a[j++];
+	}
+	memcpy(a, tmp, n * sizeof(SID));
+}
+
+/*
+ * Children of storage are sorted and linked in balanced
+ * tree: levels above the last one are full, so with nodes of
+ * the last level red and all others black it is red-black
+ * tree
+ */
+static SID _cfb_writer_tree(struct cfb_writer * w, const SID * sorted,
+		SID n, int depth, int black)
+{
+	if (n == 0)
+		return NOSTREAM;
+	SID mid = n / 2;
+	SID sid = sorted[mid];
+	cfb_dir * dir = &w->dirs[sid];
+	dir->_bflags = depth < black ? DE_BLACK : DE_RED;
+	dir->_sidLeftSib = _cfb_writer_tree(w, sorted, mid, depth + 1, black);
+	dir->_sidRightSib = _cfb_writer_tree(w, sorted + mid + 1, n - mid - 1,
+			depth + 1, black);
+	return sid;
+}
+
+// build trees of all storages, return 0 on success
+static int _cfb_writer_trees(struct cfb_writer * w){
+	SID i, n = w->dirn - 1;
+	if (n == 0)
+		return 0;
+	SID * sorted = (SID *)malloc(n * 2 * sizeof(SID));
+	if (!sorted){
+		ERR("malloc");
+		return CFB_ALLOC_ERR;
+	}
+	for (i = 0; i < n; ++i)
+		sorted[i] = i + 1;
+	_cfb_writer_sort(w, sorted, sorted + n, n);
+
+	for (i = 0; i < n;) {
+		SID j = i + 1;
+		while (j < n && w->entries[sorted[j]].parent == w->entries[sorted[i]].parent)
+			j++;
+		// number of full levels of tree of j - i nodes
+		int black = 0;
+		while (((uint64_t)1 << (black + 1)) - 1 <= j - i)
+			black++;
+		w->dirs[w->entries[sorted[i]].parent]._sidChild =
+			_cfb_writer_tree(w, sorted + i, j - i, 0, black);
+		i = j;
+	}
+	free(sorted);
+	return 0;
+}
+
+// write chain of len bytes of buf padded to sectors, return
+// first sector
+static SECT _cfb_writer_chain(struct cfb_writer * w, const void * buf,
+		size_t len)
+{
+	SECT last = ENDOFCHAIN;
+	FSINDEX n = len / w->ssize;
+	SECT first = _cfb_writer_sectors(w, buf, n, &last);
+	if (len % w->ssize){
+		uint8_t * sect = (uint8_t *)calloc(1, w->ssize);
+		if (!sect){
+			w->error = CFB_ALLOC_ERR;
+			return ENDOFCHAIN;
+		}
+		memcpy(sect, (const uint8_t *)buf + (size_t)n * w->ssize, len % w->ssize);
+		SECT s = _cfb_writer_sectors(w, sect, 1, &last);
+		if (!n)
+			first = s;
+		free(sect);
+	}
+	return len ? first : ENDOFCHAIN;
+}
+
+/*
+ * Write mini stream tail, miniFAT, directory, FAT, DIFAT and
+ * header and free writer (close file opened with
+ * cfb_writer_open), return 0 on success
+ */
+static int cfb_writer_finish(struct cfb_writer * w){
+	FSINDEX i, k;
+	int error = w->error;
+	DWORD ssize = w->ssize;
+	FSINDEX per = ssize / 4;
+
+	if (!w->fp)
+		return -1;
+	if (!error && w->stream != NOSTREAM)
+		error = cfb_writer_stream_end(w);
+
+	// last sector of mini stream
+	if (!error && (w->mfatn * 64) % ssize){
+		SECT s = _cfb_writer_sectors(w, w->msect, 1, &w->mlast);
+		if (w->mfirst == ENDOFCHAIN)
+			w->mfirst = s;
+	}
+	cfb_dir * root = &w->dirs[0];
+	root->_sectStart = w->mfatn ? w->mfirst : ENDOFCHAIN;
+	root->_ulSize = w->mfatn * 64;
+
+	// miniFAT
+	FSINDEX nmfsect = (w->mfatn + per - 1) / per;
+	SECT mfatstart = ENDOFCHAIN;
+	if (!error && nmfsect){
+		SECT * mfat = (SECT *)realloc(w->mfat, (size_t)nmfsect * ssize);
+		if (!mfat)
+			w->error = CFB_ALLOC_ERR;
+		else {
+			w->mfat = mfat;
+			for (i = w->mfatn; i < nmfsect * per; ++i)
+				mfat[i] = FREESECT;
+			htocl_array(mfat, (size_t)nmfsect * per);
+			mfatstart = _cfb_writer_chain(w, mfat, (size_t)nmfsect * ssize);
+		}
+	}
+
+	// directory
+	if (!error && !w->error)
+		error = _cfb_writer_trees(w);
+	SID dirsper = ssize / sizeof(cfb_dir);
+	FSINDEX ndirsect = (w->dirn + dirsper - 1) / dirsper;
+	SECT dirstart = ENDOFCHAIN;
+	if (!error && !w->error){
+		cfb_dir * dirs = (cfb_dir *)calloc(ndirsect * dirsper, sizeof(cfb_dir));
+		if (!dirs)
+			w->error = CFB_ALLOC_ERR;
+		else {
+			for (i = 0; i < ndirsect * dirsper; ++i) {
+				cfb_dir * dir = &dirs[i];
+				if (i < w->dirn){
+					struct _cfb_writer_entry * e = &w->entries[i];
+					*dir = w->dirs[i];
+					for (k = 0; k < (FSINDEX)e->len; ++k) {
+						dir->_ab[2*k] = e->name[k] & 0xFF;
+						dir->_ab[2*k + 1] = e->name[k] >> 8;
+					}
+					dir->_cb = (e->len + 1) * 2;
+				} else
+					dir->_sidLeftSib = dir->_sidRightSib = dir->_sidChild = NOSTREAM;
+				if (!is_little_endian())
+					_cfb_dir_sw(dir);
+			}
+			dirstart = _cfb_writer_chain(w, dirs, (size_t)ndirsect * ssize);
+			free(dirs);
+		}
+	}
+	if (!error)
+		error = w->error;
+
+	// FAT covers all sectors including FAT and DIFAT
+	FSINDEX nfat = 0, ndif = 0;
+	SECT ndata = w->fatn;
+	for (;;) {
+		FSINDEX total = ndata + nfat + ndif;
+		FSINDEX needfat = (total + per - 1) / per;
+		FSINDEX needdif = needfat <= 109 ? 0 :
+			(needfat - 109 + per - 2) / (per - 1);
+		if (needfat == nfat && needdif == ndif)
+			break;
+		nfat = needfat; ndif = needdif;
+	}
+	if (!error){
+		SECT * fat = (SECT *)realloc(w->fat, (size_t)nfat * ssize);
+		if (!fat)
+			error = CFB_ALLOC_ERR;
+		else {
+			w->fat = fat;
+			for (i = ndata; i < nfat * per; ++i)
+				fat[i] = FREESECT;
+			for (i = 0; i < nfat; ++i)
+				fat[ndata + i] = FATSECT;
+			for (i = 0; i < ndif; ++i)
+				fat[ndata + nfat + i] = DIFSECT;
+			htocl_array(fat, (size_t)nfat * per);
+			if (fwrite(fat, ssize, nfat, w->fp) != nfat)
+				error = CFB_WRITE_ERR;
+		}
+	}
+	if (!error && ndif){
+		SECT * dif = (SECT *)malloc(ssize);
+		if (!dif)
+			error = CFB_ALLOC_ERR;
+		for (i = 0; !error && i < ndif; ++i) {
+			for (k = 0; k < per - 1; ++k) {
+				FSINDEX j = 109 + i * (per - 1) + k;
+				dif[k] = htocl(j < nfat ? ndata + j : FREESECT);
+			}
+			dif[per - 1] = htocl(i + 1 < ndif ? ndata + nfat + i + 1 : ENDOFCHAIN);
+			if (fwrite(dif, ssize, 1, w->fp) != 1)
+				error = CFB_WRITE_ERR;
+		}
+		free(dif);
+	}
+
+	// header
+	if (!error){
+		cfb_header h;
+		memset(&h, 0, sizeof(cfb_header));
+		memcpy(h._abSig, cfb_signature, 8);
+		h._uMinorVersion = htocs(0x3E);
+		h._uDllVersion = htocs(w->version);
+		h._uByteOrder = htocs(0xFFFE);
+		h._uSectorShift = htocs(w->version == 4 ? 12 : 9);
+		h._uMiniSectorShift = htocs(6);
+		// number of directory sectors for version 4
+		h._ulReserved2 = htocl(w->version == 4 ? ndirsect : 0);
+		h._csectFat = htocl(nfat);
+		h._sectDirStart = htocl(dirstart);
+		h._ulMiniSectorCutoff = htocl(w->cutoff);
+		h._sectMiniFatStart = htocl(mfatstart);
+		h._csectMiniFat = htocl(nmfsect);
+		h._sectDifStart = htocl(ndif ? ndata + nfat : ENDOFCHAIN);
+		h._csectDif = htocl(ndif);
+		for (i = 0; i < 109; ++i)
+			h._sectFat[i] = htocl(i < nfat ? ndata + i : FREESECT);
+		if (fseeko(w->fp, 0, SEEK_SET) ||
+				fwrite(&h, sizeof(cfb_header), 1, w->fp) != 1 ||
+				fflush(w->fp))
+		{
+			ERR("can't write file header");
+			error = CFB_WRITE_ERR|CFB_HEADER_ERR;
+		}
+	}
+	if (w->fpown && w->fp && fclose(w->fp) && !error)
+		error = CFB_WRITE_ERR;
+	w->fpown = false;
+	_cfb_writer_free(w);
+	return error;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //CFB_WRITER_H_
+
+// vim:ft=c
@@ -17,6 +17,9 @@ extern "C"{
 #include <stdio.h>	
 #include <stdlib.h>	
 #include <errno.h>	
+#include <string.h>	
+#include <stdbool.h>	
+#include <sys/types.h>	
 #include <iconv.h>
 
 /*
@@ -40,6 +43,40 @@ encoding_for_codepage(uint16_t codepage);
 static char* 
 unicode_decode_iconv(const char *s, size_t len, iconv_t ic);
 
+/*
+ * function `codepage_iconv`
+ * Return iconv converter from codepage to UTF-8 from cache of calling thread (converter is 
+ * opened once for each codepage and should not be closed). Return (iconv_t)-1 on error.
+ */
+static iconv_t 
+codepage_iconv(uint16_t codepage);
+
+/*
+ * function `codepage_iconv_cache_clear`
+ * Close all converters of cache of calling thread (call before thread exit).
+ */
+static void 
+codepage_iconv_cache_clear(void);
+
+/*
+ * function `codepage_is_ascii`
+ * Return true if string has only ASCII characters (7-bit bytes). They are decoded to the same
+ * bytes in UTF-8 and in codepages that are ASCII supersets - not in SHIFT-JIS (932), where
+ * 0x5C is YEN SIGN and 0x7E is OVERLINE.
+ */
+static bool 
+codepage_is_ascii(const char *s, size_t len);
+
+/*
+ * function `codepage_decode`
+ * Decode string s of len bytes in codepage to UTF-8 null-terminated string in buffer out of 
+ * outlen bytes (no allocation). ASCII strings are copied with no iconv if codepage
+ * is ASCII superset (all codepages of table but 932). Return length of 
+ * decoded string or -1 on error (errno is E2BIG if buffer is too small).
+ */
+static ssize_t 
+codepage_decode(uint16_t codepage, const char *s, size_t len, char *out, size_t outlen);
+
 /*
  * IMP
  */
@@ -79,14 +116,14 @@ static struct codepage_entry_t _codepage_entries[] = {
 };
 
 static int codepage_compare(const void *key, const void *value) {
-    const struct codepage_entry_t *cp1 = key;
-    const struct codepage_entry_t *cp2 = value;
+    const struct codepage_entry_t *cp1 = (const struct codepage_entry_t *)key;
+    const struct codepage_entry_t *cp2 = (const struct codepage_entry_t *)value;
     return cp1->code - cp2->code;
 }
 
 static const char *encoding_for_codepage(uint16_t codepage) {
     struct codepage_entry_t key = { .code = codepage };
-    struct codepage_entry_t *result = bsearch(&key, _codepage_entries,
+    struct codepage_entry_t *result = (struct codepage_entry_t *)bsearch(&key, _codepage_entries,
             sizeof(_codepage_entries)/sizeof(_codepage_entries[0]),
             sizeof(_codepage_entries[0]), &codepage_compare);
     if (result) {
@@ -107,7 +144,7 @@ static char* unicode_decode_iconv(const char *s, size_t len, iconv_t ic) {
         char* out_ptr = 0;
 
         size_t st; 
-        outbuf = malloc(outlen + 1);
+        outbuf = (char *)malloc(outlen + 1);
 
 		if(outbuf)
         {
@@ -123,7 +160,7 @@ static char* unicode_decode_iconv(const char *s, size_t len, iconv_t ic) {
                         size_t diff = out_ptr - outbuf;
                         outlen += inlenleft;
                         outlenleft += inlenleft;
-                        outbuf = realloc(outbuf, outlen + 1);
+                        outbuf = (char *)realloc(outbuf, outlen + 1);
                         if(!outbuf)
                         {
                             break;
@@ -148,6 +185,118 @@ static char* unicode_decode_iconv(const char *s, size_t len, iconv_t ic) {
     return outbuf;
 }
 
+/*
+ * Cache of converters
+ */
+#ifndef CODEPAGE_CACHE_SIZE
+#define CODEPAGE_CACHE_SIZE 8 //number of converters for thread
+#endif
+
+#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define _CODEPAGE_TLS _Thread_local
+#elif defined(__GNUC__)
+#define _CODEPAGE_TLS __thread
+#else
+#define _CODEPAGE_TLS
+#endif
+
+struct _codepage_cache_t {
+	uint16_t codepage;
+	iconv_t ic;
+};
+
+static _CODEPAGE_TLS struct _codepage_cache_t _codepage_cache[CODEPAGE_CACHE_SIZE];
+static _CODEPAGE_TLS int _codepage_cachen;   //number of converters
+static _CODEPAGE_TLS int _codepage_cachenext; //next converter to replace
+
+static iconv_t codepage_iconv(uint16_t codepage) {
+	int i;
+	for (i = 0; i < _codepage_cachen; ++i) {
+		if (_codepage_cache[i].codepage == codepage){
+			//reset state of converter
+			iconv(_codepage_cache[i].ic, NULL, NULL, NULL, NULL);
+			return _codepage_cache[i].ic;
+		}
+	}
+	
+	iconv_t ic = iconv_open("UTF-8", encoding_for_codepage(codepage));
+	if (ic == (iconv_t)-1)
+		return ic;
+
+	if (_codepage_cachen < CODEPAGE_CACHE_SIZE)
+		i = _codepage_cachen++;
+	else {
+		//replace oldest converter
+		i = _codepage_cachenext;
+		_codepage_cachenext = (_codepage_cachenext + 1) % CODEPAGE_CACHE_SIZE;
+		iconv_close(_codepage_cache[i].ic);
+	}
+	_codepage_cache[i].codepage = codepage;
+	_codepage_cache[i].ic = ic;
+	return ic;
+}
+
+static void codepage_iconv_cache_clear(void) {
+	int i;
+	for (i = 0; i < _codepage_cachen; ++i)
+		iconv_close(_codepage_cache[i].ic);
+	_codepage_cachen = 0;
+	_codepage_cachenext = 0;
+}
+
+static bool codepage_is_ascii(const char *s, size_t len) {
+	size_t i = 0;
+	//check 8 bytes at once
+	for (; i + 8 <= len; i += 8) {
+		uint64_t v;
+		memcpy(&v, s + i, 8);
+		if (v & 0x8080808080808080ULL)
+			return false;
+	}
+	for (; i < len; ++i)
+		if (s[i] & 0x80)
+			return false;
+	return true;
+}
+
+//7-bit bytes of codepage are ASCII - SHIFT-JIS maps 0x5C and 0x7E to
+//U+00A5 and U+203E (codepages not in table are decoded as WINDOWS-1252)
+static bool _codepage_ascii_superset(uint16_t codepage) {
+	return codepage != 932;
+}
+
+static ssize_t codepage_decode(uint16_t codepage, const char *s, size_t len, 
+		char *out, size_t outlen) 
+{
+	if (outlen == 0){
+		errno = E2BIG;
+		return -1;
+	}
+
+	//ASCII and UTF-8 are copied
+	if (codepage == 65001 || 
+			(_codepage_ascii_superset(codepage) && codepage_is_ascii(s, len))){
+		if (len >= outlen){
+			errno = E2BIG;
+			return -1;
+		}
+		memcpy(out, s, len);
+		out[len] = 0;
+		return len;
+	}
+
+	iconv_t ic = codepage_iconv(codepage);
+	if (ic == (iconv_t)-1)
+		return -1;
+
+	char *src_ptr = (char *)s, *out_ptr = out;
+	size_t inlenleft = len, outlenleft = outlen - 1; //space for null
+	if (iconv(ic, &src_ptr, &inlenleft, &out_ptr, &outlenleft) == (size_t)(-1))
+		return -1;
+	*out_ptr = 0;
+	return out_ptr - out;
+}
+
 #ifdef __cplusplus
 }
 #endif
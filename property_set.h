@@ -17,6 +17,9 @@ extern "C"{
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include "byteorder.h"
 /*
  * While the potential for uses of persistent property sets is not fully tapped, there are  
  * currently two primary uses:
@@ -65,6 +68,68 @@ static int
 property_set_get(FILE * fp, void * user_data,
 	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value));
 
+/*
+ * function `property_set_parse_mem`
+ * Read properties from property set stored in memory (stream data read to buffer or mapped 
+ * with cfb_stream_map), execute callback for each found property. Data is not copied - value 
+ * points to buf (and should not be changed). Return error code. To stop function execution 
+ * you may return non 0 in callback function. 
+ */
+static int 
+property_set_parse_mem(const uint8_t * buf, size_t len, void * user_data,
+	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value));
+
+/*
+ * Indexed property set - offsets and types of properties of
+ * one section (no memory is allocated)
+ */
+#ifndef PSET_INDEX_MAX
+#define PSET_INDEX_MAX 32 //PROPIDs indexed directly
+#endif
+#ifndef PSET_OTHER_MAX
+#define PSET_OTHER_MAX 32 //max number of other PROPIDs
+#endif
+
+struct pset_prop {
+	uint32_t offset;  //offset of type/value pair in section (0 - no property)
+	uint32_t type;    //property type
+};
+
+typedef struct pset {
+	const uint8_t * section; //section data
+	uint32_t size;           //size of section
+	bool byteOrder;          //change byte order
+	struct pset_prop index[PSET_INDEX_MAX];
+	uint32_t nother;
+	struct {
+		uint32_t propid;
+		struct pset_prop prop;
+	} other[PSET_OTHER_MAX];
+} pset_t;
+
+/*
+ * function `pset_parse`
+ * Index section (0 - first) of property set stored in memory. Return error code
+ */
+static int 
+pset_parse(pset_t * ps, const uint8_t * buf, size_t len, uint32_t section);
+
+/*
+ * Typed getters - value is decoded from data, return 0 (or string) if property is found
+ * and has the type, -1 (NULL) otherwise. String is not null-terminated and is in codepage
+ * of property set (PROPID 1) - len is set to number of bytes
+ */
+static uint32_t 
+pset_get_type(const pset_t * ps, uint32_t propid);
+static int 
+pset_get_i2(const pset_t * ps, uint32_t propid, int16_t * value);
+static int 
+pset_get_i4(const pset_t * ps, uint32_t propid, int32_t * value);
+static int 
+pset_get_filetime(const pset_t * ps, uint32_t propid, uint64_t * value);
+static const char * 
+pset_get_lpstr(const pset_t * ps, uint32_t propid, size_t * len);
+
 
 /*
  * Error codes
@@ -240,55 +305,119 @@ typedef struct tagSERIALIZEDPROPERTYVALUE
  */
 
 //switch bite order
-uint64_t PS_DDWORD_SW (uint64_t i)
+#define PS_DDWORD_SW(i) bswap_64(i)
+#define PS_DWORD_SW(i)  bswap_32(i)
+#define PS_WORD_SW(i)   bswap_16(i)
+
+//get DWORD from buffer (may be not aligned)
+static uint32_t _ps_dword(const uint8_t * p, bool byteOrder)
 {
-    unsigned char c1, c2, c3, c4, c5, c6, c7, c8;
-
-	c1 = i & 255;
-	c2 = (i >> 8) & 255;
-	c3 = (i >> 16) & 255;
-	c4 = (i >> 24) & 255;
-	c5 = (i >> 32) & 255;
-	c6 = (i >> 40) & 255;
-	c7 = (i >> 48) & 255;
-	c8 = (i >> 54) & 255;
-
-	return ((uint64_t)c1 << 54) + 
-		   ((uint64_t)c2 << 48) + 
-		   ((uint64_t)c3 << 40) + 
-		   ((uint64_t)c4 << 32) + 
-		   ((uint64_t)c5 << 24) + 
-		   ((uint64_t)c6 << 16) + 
-		   ((uint64_t)c7 << 8)  + c8;
+	uint32_t v;
+	memcpy(&v, p, 4);
+	return byteOrder ? PS_DWORD_SW(v) : v;
 }
 
-uint32_t PS_DWORD_SW (uint32_t i)
+//check property set header, get byte order and count of sections
+static int _ps_header(const uint8_t * buf, size_t len, bool * byteOrder, uint32_t * count)
 {
-    unsigned char c1, c2, c3, c4;
-
-	c1 = i & 255;
-	c2 = (i >> 8) & 255;
-	c3 = (i >> 16) & 255;
-	c4 = (i >> 24) & 255;
-
-	return ((int)c1 << 24) + 
-		   ((int)c2 << 16) + 
-		   ((int)c3 << 8)  + c4;
+	if (len < sizeof(PROPERTYSETHEADER))
+		return PSET_ERR_HEADER;
+	
+	//check bite order - should be 0xfffe
+	uint16_t wByteOrder;
+	memcpy(&wByteOrder, buf, 2);
+	if (wByteOrder == 0xFFFE){ // LE byte order 
+		*byteOrder = false;
+	} else if (wByteOrder == 0xFEFF){
+		// need to change byte order
+		*byteOrder = true;
+	} else
+		return PSET_ERR_HEADER; //error to read header
+	
+	*count = _ps_dword(buf + offsetof(PROPERTYSETHEADER, count), *byteOrder);
+	return PSET_NO_ERR;
 }
 
-uint16_t PS_WORD_SW (uint16_t i)
+//get section i of property set - data, size and count of properties
+static int _ps_section(const uint8_t * buf, size_t len, bool byteOrder, uint32_t i,
+		const uint8_t ** section, uint32_t * cbSection, uint32_t * cProperties)
 {
-    unsigned char c1, c2;
-    
-	c1 = i & 255;
-	c2 = (i >> 8) & 255;
+	//format/offset pair
+	size_t p = sizeof(PROPERTYSETHEADER) + (size_t)i * sizeof(FORMATIDOFFSET);
+	if (p + sizeof(FORMATIDOFFSET) > len)
+		return PSET_ERR_HEADER;
+	uint32_t dwOffset = _ps_dword(buf + p + offsetof(FORMATIDOFFSET, dwOffset), byteOrder);
+	
+	//get property section header
+	if (dwOffset > len || len - dwOffset < sizeof(PROPERTYSECTIONHEADER))
+		return PSET_ERR_HEADER;
+	*section = buf + dwOffset;
+	*cbSection = _ps_dword(*section, byteOrder);
+	*cProperties = _ps_dword(*section + 4, byteOrder);
+	//section can't be out of data
+	if (*cbSection > len - dwOffset)
+		*cbSection = len - dwOffset;
+	if (*cbSection < sizeof(PROPERTYSECTIONHEADER))
+		return PSET_ERR_HEADER;
+	if (*cProperties > (*cbSection - sizeof(PROPERTYSECTIONHEADER)) 
+			/ sizeof(PROPERTYIDOFFSET))
+		return PSET_ERR_HEADER;
+	return PSET_NO_ERR;
+}
 
-	return (c1 << 8) + c2;
+//check that value of type (size bytes to end of section) is in section
+static bool _ps_value_ok(uint32_t dwType, const uint8_t * ptr, size_t size, bool byteOrder)
+{
+	if (dwType == PSET_I2 || dwType == PSET_UI2 || dwType == PSET_BOOL)
+		return size >= 2;
+	if (dwType == PSET_I4 || dwType == PSET_R4 || dwType == PSET_UI4 || 
+			dwType == PSET_INT || dwType == PSET_UINT)
+		return size >= 4;
+	if (dwType == PSET_I8 || dwType == PSET_R8 || dwType == PSET_UI8 || 
+			dwType == PSET_FILETIME)
+		return size >= 8;
+	if (dwType == PSET_LPSTR || dwType == PSET_BSTR || dwType == PSET_BLOB || 
+			dwType == PSET_CF || dwType == PSET_LPWSTR)
+	{
+		//length-prefixed value should be in section
+		if (size < 4)
+			return false;
+		uint64_t cb = _ps_dword(ptr, byteOrder);
+		if (dwType == PSET_LPWSTR)
+			cb *= 2;
+		return cb <= size - 4;
+	}
+	if (dwType & PSET_VECTOR)
+		return size >= 4;
+	return true;
 }
 
+//swap byte order of scalar value to tmp, return pointer to value
+static uint8_t * _ps_value_sw(uint32_t dwType, uint8_t * ptr, uint64_t * tmp)
+{
+	if (dwType == PSET_I2 || dwType == PSET_UI2){
+		uint16_t v16;
+		memcpy(&v16, ptr, 2);
+		v16 = PS_WORD_SW(v16);
+		memcpy(tmp, &v16, 2);
+		return (uint8_t *)tmp;
+	}
+	if (dwType == PSET_I4 || dwType == PSET_R4 || dwType == PSET_UI4){
+		uint32_t v32 = _ps_dword(ptr, true);
+		memcpy(tmp, &v32, 4);
+		return (uint8_t *)tmp;
+	}				
+	if (dwType == PSET_I8 || dwType == PSET_R8 || dwType == PSET_UI8){
+		memcpy(tmp, ptr, 8);
+		*tmp = PS_DDWORD_SW(*tmp);
+		return (uint8_t *)tmp;
+	}
+	return ptr;
+}
 
-int property_set_get(
-			FILE * fp,            //file pointer
+int property_set_parse_mem(
+			const uint8_t * buf,  //property set data
+			size_t len,           //size of data
 			void * user_data,     //data to transfer to callback
 			int (*callback)(      //callback for each propertry - return non 0 to stop
 				void * user_data, //data to transfet
@@ -298,118 +427,220 @@ int property_set_get(
 			)
 		)
 {
-	int i, k, c;
-	size_t len;
-	bool byteOrder = false;
-
-	//get property stream header
-	PROPERTYSETHEADER head;
-	fseek(fp, 0, SEEK_SET);
-	len = fread(&head, 1, sizeof(PROPERTYSETHEADER), fp);	
-	if (len != sizeof(PROPERTYSETHEADER))
-		return PSET_ERR_FILE; //error to read file
-	
-	//check bite order - should be 0xfffe
-	if (head.wByteOrder == 0xFFFE){ // LE byte order 
-	} else if (head.wByteOrder == 0xFEFF){
-		// need to change byte order
-		byteOrder = true;
-	} else
-		return PSET_ERR_HEADER; //error to read header
-							
-	if (byteOrder){
-		head.wFormat = PS_WORD_SW(head.wFormat);
-		head.dwOSVer = PS_DWORD_SW(head.dwOSVer);
-		for (i = 0; i < 4; ++i) 
-			head.clsID[i] = PS_DWORD_SW(head.clsID[i]); 
+	uint32_t i, k, count;
+	bool byteOrder;
 
-		head.count = PS_DWORD_SW(head.count);
-	}
-	
-	//get sectors
-	for (i = 0; i < head.count; ++i) {
-		//format/offset pair
-		FORMATIDOFFSET soff;
-		fseek(fp, sizeof(PROPERTYSETHEADER) + i*sizeof(soff), SEEK_SET);
-		fread(&soff, 1, sizeof(FORMATIDOFFSET), fp);
-		if (byteOrder){
-			for (i = 0; i < 4; ++i) 
-				soff.fmtid[i] = PS_DWORD_SW(soff.fmtid[i]); 			
-			soff.dwOffset = PS_DWORD_SW(soff.dwOffset);
-		}		
-		
-		//get property section header
-		PROPERTYSECTIONHEADER pshead;
-		fseek(fp, soff.dwOffset, SEEK_SET);
-		fread(&pshead, 1, sizeof(PROPERTYSECTIONHEADER), fp);		
-		if (byteOrder){
-			pshead.cbSection = PS_DWORD_SW(pshead.cbSection);
-			pshead.cProperties = PS_DWORD_SW(pshead.cProperties);
-		}
-
-		//copy section to buf
-		uint8_t * buf = malloc(pshead.cbSection*4);
-		if (!buf)
-			return PSET_ERR_ALLOC;
-		fseek(fp, soff.dwOffset, SEEK_SET);
-		fread(buf, 1, pshead.cbSection*4, fp);				
+	//check property stream header
+	int ret = _ps_header(buf, len, &byteOrder, &count);
+	if (ret)
+		return ret;
+							
+	//get sections
+	for (i = 0; i < count; ++i) {
+		const uint8_t * section;
+		uint32_t cbSection, cProperties;
+		ret = _ps_section(buf, len, byteOrder, i, &section, &cbSection, &cProperties);
+		if (ret)
+			return ret;
 
 		//for each property
-		for (k = 0; k < pshead.cProperties; ++k) {
+		for (k = 0; k < cProperties; ++k) {
 			//get propery offset
-			PROPERTYIDOFFSET poff;	
-			fseek(fp, soff.dwOffset 
-					+ sizeof(PROPERTYSECTIONHEADER) 
-							+ k*sizeof(PROPERTYIDOFFSET), SEEK_SET);
-			fread(&poff, 1, sizeof(PROPERTYIDOFFSET), fp);			
-			if (byteOrder){
-				poff.propid = PS_DWORD_SW(poff.propid);
-				poff.dwOffset = PS_DWORD_SW(poff.dwOffset);
-			}
+			const uint8_t * poff = section + sizeof(PROPERTYSECTIONHEADER) 
+				+ (size_t)k * sizeof(PROPERTYIDOFFSET);
+			uint32_t propid = _ps_dword(poff, byteOrder);
+			uint32_t off = _ps_dword(poff + 4, byteOrder);
+			//skip property out of section
+			if (off > cbSection || cbSection - off < 4)
+				continue;
 
 			//get type/value pair 
-			SERIALIZEDPROPERTYVALUE ptv;
-			fseek(fp, soff.dwOffset + poff.dwOffset, SEEK_SET);
-			fread(&ptv, 1, sizeof(SERIALIZEDPROPERTYVALUE), fp);			
-			if (byteOrder)
-				ptv.dwType = PS_DWORD_SW(ptv.dwType);
+			uint32_t dwType = _ps_dword(section + off, byteOrder);
+			uint8_t * ptr = (uint8_t *)(section + off + 4);
+			if (!_ps_value_ok(dwType, ptr, cbSection - off - 4, byteOrder))
+				continue;
 
 			//pointer to value
-			uint8_t * ptr = buf + poff.dwOffset + 4;
-			uint16_t *v16;
-			uint32_t *v32;
-			uint64_t *v64;
-			
-			if (byteOrder){
-				if (ptv.dwType == PSET_I2||ptv.dwType ==  PSET_UI2){
-					v16 = (uint16_t *)ptr;
-					*v16 = PS_WORD_SW(*v16);
-					ptr = (uint8_t *)v16;		  
-				}
-				else if (ptv.dwType == PSET_I4 || ptv.dwType == PSET_R4 || ptv.dwType == PSET_UI4){
-					v32 = (uint32_t *)ptr;
-					*v32 = PS_DWORD_SW(*v32);
-					ptr = (uint8_t *)v32;		  
-				}				
-				else if (ptv.dwType == PSET_I8 || ptv.dwType == PSET_R8 || ptv.dwType == PSET_UI8 || ptv.dwType == PSET_I8){
-					v64 = (uint64_t *)ptr;
-					*v64 = PS_DDWORD_SW(*v64);
-					ptr = (uint8_t *)v64;		  
-				}				
-			}
+			uint64_t v;
+			if (byteOrder)
+				ptr = _ps_value_sw(dwType, ptr, &v);
 
 			//callback
 			if (callback)
-				if (callback(user_data, poff.propid, ptv.dwType, ptr))
+				if (callback(user_data, propid, dwType, ptr))
 					return PSET_CB_STOP;
 		}	
+	}
 
-		free(buf);
+	return PSET_NO_ERR;
+}
+
+/*
+ * Indexed property set
+ * Section of property set in memory is indexed once - offset
+ * and type of property is found by PROPID with no scan, and
+ * value is decoded only in getter. Small PROPIDs (all of
+ * summary information) are indexed directly, others are kept
+ * in small table. No memory is allocated - data should be
+ * valid while pset is used.
+ */
+int pset_parse(pset_t * ps, const uint8_t * buf, size_t len, uint32_t section)
+{
+	uint32_t k, count;
+	memset(ps, 0, sizeof(pset_t));
+
+	int ret = _ps_header(buf, len, &ps->byteOrder, &count);
+	if (ret)
+		return ret;
+	if (section >= count)
+		return PSET_ERR_HEADER;
+	
+	uint32_t cProperties;
+	ret = _ps_section(buf, len, ps->byteOrder, section, 
+			&ps->section, &ps->size, &cProperties);
+	if (ret)
+		return ret;
+
+	for (k = 0; k < cProperties; ++k) {
+		const uint8_t * poff = ps->section + sizeof(PROPERTYSECTIONHEADER) 
+			+ (size_t)k * sizeof(PROPERTYIDOFFSET);
+		uint32_t propid = _ps_dword(poff, ps->byteOrder);
+		uint32_t off = _ps_dword(poff + 4, ps->byteOrder);
+		//skip property out of section
+		if (off < sizeof(PROPERTYSECTIONHEADER) || off > ps->size || ps->size - off < 4)
+			continue;
+		
+		struct pset_prop * prop = NULL;
+		if (propid < PSET_INDEX_MAX)
+			prop = &ps->index[propid];
+		else if (ps->nother < PSET_OTHER_MAX){
+			ps->other[ps->nother].propid = propid;
+			prop = &ps->other[ps->nother++].prop;
+		}
+		//first property with PROPID is used
+		if (!prop || prop->offset)
+			continue;
+		prop->offset = off;
+		prop->type = _ps_dword(ps->section + off, ps->byteOrder);
 	}
 
 	return PSET_NO_ERR;
 }
 
+//get value of property, return NULL if not found or value is out of section
+static const uint8_t * _pset_find(const pset_t * ps, uint32_t propid, uint32_t * type)
+{
+	const struct pset_prop * prop = NULL;
+	uint32_t i;
+	if (propid < PSET_INDEX_MAX)
+		prop = &ps->index[propid];
+	else 
+		for (i = 0; i < ps->nother; ++i)
+			if (ps->other[i].propid == propid){
+				prop = &ps->other[i].prop;
+				break;
+			}
+	if (!prop || !prop->offset)
+		return NULL;
+
+	const uint8_t * ptr = ps->section + prop->offset + 4;
+	if (!_ps_value_ok(prop->type, ptr, ps->size - prop->offset - 4, ps->byteOrder))
+		return NULL;
+	*type = prop->type;
+	return ptr;
+}
+
+//get type of property, return PSET_EMPTY if not found
+uint32_t pset_get_type(const pset_t * ps, uint32_t propid)
+{
+	uint32_t type;
+	if (!_pset_find(ps, propid, &type))
+		return PSET_EMPTY;
+	return type;
+}
+
+int pset_get_i2(const pset_t * ps, uint32_t propid, int16_t * value)
+{
+	uint32_t type;
+	const uint8_t * ptr = _pset_find(ps, propid, &type);
+	if (!ptr || (type != PSET_I2 && type != PSET_UI2 && type != PSET_BOOL))
+		return -1;
+	uint16_t v;
+	memcpy(&v, ptr, 2);
+	*value = ps->byteOrder ? PS_WORD_SW(v) : v;
+	return 0;
+}
+
+int pset_get_i4(const pset_t * ps, uint32_t propid, int32_t * value)
+{
+	uint32_t type;
+	const uint8_t * ptr = _pset_find(ps, propid, &type);
+	if (!ptr || (type != PSET_I4 && type != PSET_UI4 && 
+				type != PSET_INT && type != PSET_UINT))
+		return -1;
+	*value = _ps_dword(ptr, ps->byteOrder);
+	return 0;
+}
+
+int pset_get_filetime(const pset_t * ps, uint32_t propid, uint64_t * value)
+{
+	uint32_t type;
+	const uint8_t * ptr = _pset_find(ps, propid, &type);
+	if (!ptr || type != PSET_FILETIME)
+		return -1;
+	//FILETIME is two DWORDs - low and high
+	*value = (uint64_t)_ps_dword(ptr + 4, ps->byteOrder) << 32 
+		| _ps_dword(ptr, ps->byteOrder);
+	return 0;
+}
+
+const char * pset_get_lpstr(const pset_t * ps, uint32_t propid, size_t * len)
+{
+	uint32_t type;
+	const uint8_t * ptr = _pset_find(ps, propid, &type);
+	if (!ptr || type != PSET_LPSTR)
+		return NULL;
+	//length includes null terminator
+	size_t n = _ps_dword(ptr, ps->byteOrder);
+	const char * str = (const char *)ptr + 4;
+	while (n > 0 && str[n - 1] == 0)
+		n--;
+	if (len)
+		*len = n;
+	return str;
+}
+
+int property_set_get(
+			FILE * fp,            //file pointer
+			void * user_data,     //data to transfer to callback
+			int (*callback)(      //callback for each propertry - return non 0 to stop
+				void * user_data, //data to transfet
+				uint32_t propid,  //property id
+				uint32_t dwType,  //property type
+				uint8_t *value    //pointer to property value
+			)
+		)
+{
+	//read property set to memory
+	if (fseek(fp, 0, SEEK_END))
+		return PSET_ERR_FILE;
+	long len = ftell(fp);
+	if (len < 0 || fseek(fp, 0, SEEK_SET))
+		return PSET_ERR_FILE;
+	
+	uint8_t * buf = (uint8_t *)malloc(len ? len : 1);
+	if (!buf)
+		return PSET_ERR_ALLOC;
+	if (fread(buf, 1, len, fp) != (size_t)len){
+		free(buf);
+		return PSET_ERR_FILE; //error to read file
+	}
+
+	int ret = property_set_parse_mem(buf, len, user_data, callback);
+	free(buf);
+	return ret;
+}
+
 #ifdef __cplusplus
 }
 #endif
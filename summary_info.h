@@ -50,6 +50,28 @@ summary_get_DocumentSummaryInformation(struct cfb * cfb, void * user_data,
 	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value));
 
 
+/*
+ * function `summary_get_SummaryInformation_mask`
+ * Same as summary_get_SummaryInformation but only properties with PROPIDs in mask 
+ * (SUMMARY_MASK(PIDSI_TITLE)|SUMMARY_MASK(PIDSI_AUTHOR)...) are read: property table is read 
+ * and then only values of wanted properties, function returns when all of them are found. 
+ * Large values that are not wanted (PIDSI_THUMBNAIL) are not read.
+ */
+#define SUMMARY_MASK(pid) (1u << (pid))
+
+static int 
+summary_get_SummaryInformation_mask(struct cfb * cfb, uint32_t mask, void * user_data,
+	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value));
+
+/*
+ * function `summary_get_DocumentSummaryInformation_mask`
+ * Same as summary_get_SummaryInformation_mask for properties of first section of 
+ * DocumentSummaryInformation (PIDDSI_)
+ */
+static int 
+summary_get_DocumentSummaryInformation_mask(struct cfb * cfb, uint32_t mask, void * user_data,
+	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value));
+
 /*
  * IMP
  */
@@ -265,18 +287,180 @@ static const top_t DSIPS[] =              //DocumentSummaryInformation property
  * applications.
  */
 
-int _summary_get(struct cfb * cfb, int doc_summary, void * user_data,
+static int _summary_get(struct cfb * cfb, int doc_summary, void * user_data,
 	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value))
 {
-	char * dirname = "\005SummaryInformation";
+	const char * dirname = "\005SummaryInformation";
 	if (doc_summary) 
 		dirname = "\005DocumentSummaryInformation";
 
-	FILE * stream = cfb_get_stream_by_name(cfb, dirname);
-	if (!stream)
+	cfb_dir dir;
+	cfb_stream stream;
+	if (cfb_get_dir_by_name(cfb, &dir, dirname) || 
+			cfb_stream_open(cfb, &dir, &stream))
 		return PSET_ERR_FILE;	
 
-	return  property_set_get(stream, user_data, callback);
+	//parse mapped stream data or read it to memory
+	ULONG size = cfb_stream_size(&stream);
+	size_t len = size;
+	uint8_t * buf = NULL;
+	const uint8_t * data = cfb_stream_map(&stream, 0, &len);
+	if (!data || len < size){
+		buf = (uint8_t *)_cfb_alloc(cfb, size ? size : 1);
+		if (!buf){
+			cfb_stream_close(&stream);
+			return PSET_ERR_ALLOC;
+		}
+		if (cfb_stream_read(&stream, 0, buf, size) != (ssize_t)size){
+			_cfb_free(cfb, buf);
+			cfb_stream_close(&stream);
+			return PSET_ERR_FILE;
+		}
+		data = buf;
+	}
+
+	int ret = property_set_parse_mem(data, size, user_data, callback);
+	_cfb_free(cfb, buf);
+	cfb_stream_close(&stream);
+	return ret;
+}
+
+//read len bytes of stream from offset to buffer (grown if needed,
+//data of buffer is not kept)
+static int _summary_read(cfb_stream * stream, ULONG offset, size_t len, 
+		uint8_t ** buf, size_t * bufsize)
+{
+	if (!_cfb_buf(stream->cfb, (void **)buf, bufsize, len))
+		return PSET_ERR_ALLOC;
+	if (cfb_stream_read(stream, offset, *buf, len) != (ssize_t)len)
+		return PSET_ERR_FILE;
+	return PSET_NO_ERR;
+}
+
+static int _summary_get_mask(struct cfb * cfb, int doc_summary, uint32_t mask, 
+	void * user_data,
+	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value))
+{
+	const char * dirname = "\005SummaryInformation";
+	if (doc_summary) 
+		dirname = "\005DocumentSummaryInformation";
+
+	cfb_dir dir;
+	cfb_stream stream;
+	if (cfb_get_dir_by_name(cfb, &dir, dirname) || 
+			cfb_stream_open(cfb, &dir, &stream))
+		return PSET_ERR_FILE;	
+	ULONG size = cfb_stream_size(&stream);
+
+	uint8_t * buf = NULL;
+	size_t bufsize = 0;
+	uint32_t i, k, count, n = 0;
+	uint32_t dwOffset, cbSection, cProperties, found = 0;
+	bool byteOrder;
+	struct { uint32_t propid, off; } wanted[32];
+	uint32_t end[32];
+
+	//header and offset of first section
+	size_t len = sizeof(PROPERTYSETHEADER) + sizeof(FORMATIDOFFSET);
+	int ret = _summary_read(&stream, 0, len, &buf, &bufsize);
+	if (!ret)
+		ret = _ps_header(buf, len, &byteOrder, &count);
+	if (!ret && count == 0)
+		ret = PSET_ERR_HEADER;
+	if (ret)
+		goto _summary_get_mask_end;
+	dwOffset = _ps_dword(buf + sizeof(PROPERTYSETHEADER) 
+			+ offsetof(FORMATIDOFFSET, dwOffset), byteOrder);
+
+	//section header and property table
+	if (dwOffset > size || size - dwOffset < sizeof(PROPERTYSECTIONHEADER)){
+		ret = PSET_ERR_HEADER;
+		goto _summary_get_mask_end;
+	}
+	ret = _summary_read(&stream, dwOffset, sizeof(PROPERTYSECTIONHEADER), &buf, &bufsize);
+	if (ret)
+		goto _summary_get_mask_end;
+	cbSection = _ps_dword(buf, byteOrder);
+	cProperties = _ps_dword(buf + 4, byteOrder);
+	if (cbSection > size - dwOffset)
+		cbSection = size - dwOffset;
+	if (cbSection < sizeof(PROPERTYSECTIONHEADER) || 
+			cProperties > (cbSection - sizeof(PROPERTYSECTIONHEADER)) 
+				/ sizeof(PROPERTYIDOFFSET))
+	{
+		ret = PSET_ERR_HEADER;
+		goto _summary_get_mask_end;
+	}
+	len = (size_t)cProperties * sizeof(PROPERTYIDOFFSET);
+	ret = _summary_read(&stream, dwOffset + sizeof(PROPERTYSECTIONHEADER), len, 
+			&buf, &bufsize);
+	if (ret)
+		goto _summary_get_mask_end;
+
+	//wanted properties (first one for each PROPID)
+	for (k = 0; k < cProperties; ++k) {
+		uint32_t propid = _ps_dword(buf + k * sizeof(PROPERTYIDOFFSET), byteOrder);
+		uint32_t off = _ps_dword(buf + k * sizeof(PROPERTYIDOFFSET) + 4, byteOrder);
+		if (propid >= 32 || !(mask & SUMMARY_MASK(propid)) || 
+				(found & SUMMARY_MASK(propid)))
+			continue;
+		if (off > cbSection || cbSection - off < 4)
+			continue;
+		found |= SUMMARY_MASK(propid);
+		wanted[n].propid = propid;
+		wanted[n].off = off;
+		n++;
+	}
+
+	//value ends at next property (values are not overlapped) or at end of section
+	for (i = 0; i < n; ++i) {
+		end[i] = cbSection;
+		for (k = 0; k < cProperties; ++k) {
+			uint32_t off = _ps_dword(buf + k * sizeof(PROPERTYIDOFFSET) + 4, byteOrder);
+			if (off > wanted[i].off && off < end[i])
+				end[i] = off;
+		}
+	}
+
+	//read values
+	for (i = 0; i < n; ++i) {
+		len = end[i] - wanted[i].off;
+		ret = _summary_read(&stream, dwOffset + wanted[i].off, len, &buf, &bufsize);
+		if (ret)
+			goto _summary_get_mask_end;
+
+		uint32_t dwType = _ps_dword(buf, byteOrder);
+		uint8_t * ptr = buf + 4;
+		if (!_ps_value_ok(dwType, ptr, len - 4, byteOrder))
+			continue;
+		uint64_t v;
+		if (byteOrder)
+			ptr = _ps_value_sw(dwType, ptr, &v);
+		
+		if (callback)
+			if (callback(user_data, wanted[i].propid, dwType, ptr)){
+				ret = PSET_CB_STOP;
+				goto _summary_get_mask_end;
+			}
+	}
+
+_summary_get_mask_end:
+	_cfb_free(cfb, buf);
+	cfb_stream_close(&stream);
+	return ret;
+}
+
+int summary_get_SummaryInformation_mask(struct cfb * cfb, uint32_t mask, void * user_data,
+	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value))
+{
+	return _summary_get_mask(cfb, 0, mask, user_data, callback);
+}
+
+int summary_get_DocumentSummaryInformation_mask(struct cfb * cfb, uint32_t mask, 
+	void * user_data,
+	int (*callback)(void * user_data, uint32_t propid, uint32_t dwType, uint8_t * value))
+{
+	return _summary_get_mask(cfb, 1, mask, user_data, callback);
 }
 
 int summary_get_SummaryInformation(struct cfb * cfb, void * user_data,